@@ -0,0 +1,919 @@
+/*
+    SIMD image helper functions, see image_helper_simd.h
+
+    Every vector path repeats the scalar arithmetic operation for operation
+    (same float expression order, same integer rounding), so the output is
+    bit-identical to image_helper.c.  Pixels a vector path does not cover
+    (row tails, odd sizes, unusual block sizes) go through scalar code.
+
+    MIT license
+*/
+
+#include "image_helper_simd.h"
+#include "image_helper.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define IH_X86 0
+#endif
+
+/*	GCC and clang only emit SSE4.1/AVX2 inside functions marked for it	*/
+#if defined(__GNUC__) || defined(__clang__)
+#define IH_TARGET(x) __attribute__((target(x)))
+#else
+#define IH_TARGET(x)
+#endif
+
+/*	-1 until the CPU was checked	*/
+static int detected_level = -1;
+static int current_level = -1;
+
+static int
+	detect_level
+	(
+		void
+	)
+{
+#if IH_X86
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) ) { return IMAGE_HELPER_AVX2; }
+	if( __builtin_cpu_supports( "sse4.1" ) ) { return IMAGE_HELPER_SSE41; }
+#elif defined(_MSC_VER)
+	int info[4];
+	int max_leaf, sse41, avx;
+	__cpuid( info, 0 );
+	max_leaf = info[0];
+	__cpuid( info, 1 );
+	sse41 = (info[2] >> 19) & 1;
+	/*	AVX needs OS support for the YMM state (OSXSAVE and XCR0)	*/
+	avx = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1) && ((_xgetbv( 0 ) & 6) == 6);
+	if( avx && (max_leaf >= 7) )
+	{
+		__cpuidex( info, 7, 0 );
+		if( (info[1] >> 5) & 1 ) { return IMAGE_HELPER_AVX2; }
+	}
+	if( sse41 ) { return IMAGE_HELPER_SSE41; }
+#endif
+#endif
+	return IMAGE_HELPER_SCALAR;
+}
+
+int
+	image_helper_simd_level
+	(
+		void
+	)
+{
+	/*	racing threads all store the same value	*/
+	if( current_level < 0 )
+	{
+		detected_level = detect_level();
+		current_level = detected_level;
+	}
+	return current_level;
+}
+
+void
+	image_helper_simd_set_level
+	(
+		int level
+	)
+{
+	image_helper_simd_level();
+	if( level < IMAGE_HELPER_SCALAR ) { level = IMAGE_HELPER_SCALAR; }
+	current_level = (level < detected_level) ? level : detected_level;
+}
+
+#if IH_X86
+
+/*
+	up_scale_image
+	--------------
+	The horizontal sample position of every output byte is the same on
+	each row, so it is worked out once: the offset of its top left source
+	byte and the fractional x.  Rows then gather the four source samples
+	and blend 4 (SSE) or 8 (AVX2) output bytes at a time.  Samples come
+	from float copies of the two source rows, which is exact and only
+	redone when the source row changes.
+*/
+typedef struct
+{
+	int* offset;
+	float* fraction;
+	/*	the two source rows being blended, as floats	*/
+	float* rows[2];
+	int cached_row;
+} up_scale_columns;
+
+static void
+	up_scale_release
+	(
+		up_scale_columns* cols
+	)
+{
+	free( cols->offset );
+	free( cols->fraction );
+	free( cols->rows[0] );
+}
+
+static int
+	up_scale_setup
+	(
+		up_scale_columns* cols,
+		int width, int channels, int resampled_width
+	)
+{
+	const float dx = (width - 1.0f) / (resampled_width - 1.0f);
+	const int count = resampled_width * channels;
+	int x, c;
+	cols->offset = (int*)malloc( count * sizeof(int) );
+	cols->fraction = (float*)malloc( count * sizeof(float) );
+	cols->rows[0] = (float*)malloc( 2 * width * channels * sizeof(float) );
+	cols->rows[1] = cols->rows[0] + width * channels;
+	cols->cached_row = -1;
+	if( (cols->offset == NULL) || (cols->fraction == NULL) || (cols->rows[0] == NULL) )
+	{
+		up_scale_release( cols );
+		return 0;
+	}
+	for( x = 0; x < resampled_width; ++x )
+	{
+		/*	exactly as up_scale_image does it	*/
+		float samplex = x * dx;
+		int intx = (int)samplex;
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		for( c = 0; c < channels; ++c )
+		{
+			cols->offset[x*channels + c] = intx * channels + c;
+			cols->fraction[x*channels + c] = samplex;
+		}
+	}
+	return 1;
+}
+
+/*	converts source rows inty and inty+1 unless they are already cached	*/
+static void
+	up_scale_load_rows
+	(
+		up_scale_columns* cols,
+		const unsigned char* const orig,
+		int width, int channels, int inty
+	)
+{
+	const int count = width * channels;
+	const unsigned char* src = orig + inty * count;
+	int k;
+	if( cols->cached_row == inty )
+	{
+		return;
+	}
+	for( k = 0; k < 2 * count; ++k )
+	{
+		cols->rows[0][k] = src[k];
+	}
+	cols->cached_row = inty;
+}
+
+/*	the scalar blend, used for the row tails	*/
+static unsigned char
+	up_scale_sample
+	(
+		const float* row0, const float* row1,
+		int offset, int channels, float samplex, float sampley
+	)
+{
+	float value = 0.5f;
+	value += row0[offset]
+				*(1.0f-samplex)*(1.0f-sampley);
+	value += row0[offset+channels]
+				*(samplex)*(1.0f-sampley);
+	value += row1[offset]
+				*(1.0f-samplex)*(sampley);
+	value += row1[offset+channels]
+				*(samplex)*(sampley);
+	return (unsigned char)(value);
+}
+
+IH_TARGET("sse4.1")
+static void
+	up_scale_rows_sse41
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		up_scale_columns* cols
+	)
+{
+	const float dy = (height - 1.0f) / (resampled_height - 1.0f);
+	const int count = resampled_width * channels;
+	const __m128 one = _mm_set1_ps( 1.0f );
+	int y, k;
+	for( y = 0; y < resampled_height; ++y )
+	{
+		float sampley = y * dy;
+		int inty = (int)sampley;
+		const float* row0;
+		const float* row1;
+		unsigned char* out = resampled + y*resampled_width*channels;
+		__m128 sy, osy;
+		if( inty > height - 2 ) { inty = height - 2; }
+		sampley -= inty;
+		up_scale_load_rows( cols, orig, width, channels, inty );
+		row0 = cols->rows[0];
+		row1 = cols->rows[1];
+		sy = _mm_set1_ps( sampley );
+		osy = _mm_sub_ps( one, sy );
+		for( k = 0; k + 4 <= count; k += 4 )
+		{
+			const int* o = cols->offset + k;
+			__m128 sx = _mm_loadu_ps( cols->fraction + k );
+			__m128 osx = _mm_sub_ps( one, sx );
+			__m128 a = _mm_setr_ps( row0[o[0]], row0[o[1]], row0[o[2]], row0[o[3]] );
+			__m128 b = _mm_setr_ps( row0[o[0]+channels], row0[o[1]+channels], row0[o[2]+channels], row0[o[3]+channels] );
+			__m128 c = _mm_setr_ps( row1[o[0]], row1[o[1]], row1[o[2]], row1[o[3]] );
+			__m128 d = _mm_setr_ps( row1[o[0]+channels], row1[o[1]+channels], row1[o[2]+channels], row1[o[3]+channels] );
+			__m128 value = _mm_set1_ps( 0.5f );
+			__m128i v;
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( a, osx ), osy ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( b, sx ), osy ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( c, osx ), sy ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( d, sx ), sy ) );
+			/*	values are in [0.5, 255.5], truncation matches the (unsigned char) cast	*/
+			v = _mm_cvttps_epi32( value );
+			v = _mm_packus_epi32( v, v );
+			v = _mm_packus_epi16( v, v );
+			{
+				int packed = _mm_cvtsi128_si32( v );
+				memcpy( out + k, &packed, 4 );
+			}
+		}
+		for( ; k < count; ++k )
+		{
+			out[k] = up_scale_sample( row0, row1, cols->offset[k], channels, cols->fraction[k], sampley );
+		}
+	}
+}
+
+IH_TARGET("avx2")
+static void
+	up_scale_rows_avx2
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height,
+		up_scale_columns* cols
+	)
+{
+	const float dy = (height - 1.0f) / (resampled_height - 1.0f);
+	const int count = resampled_width * channels;
+	const __m256 one = _mm256_set1_ps( 1.0f );
+	const __m256i ch = _mm256_set1_epi32( channels );
+	int y, k;
+	for( y = 0; y < resampled_height; ++y )
+	{
+		float sampley = y * dy;
+		int inty = (int)sampley;
+		const float* row0;
+		const float* row1;
+		unsigned char* out = resampled + y*resampled_width*channels;
+		__m256 sy, osy;
+		if( inty > height - 2 ) { inty = height - 2; }
+		sampley -= inty;
+		up_scale_load_rows( cols, orig, width, channels, inty );
+		row0 = cols->rows[0];
+		row1 = cols->rows[1];
+		sy = _mm256_set1_ps( sampley );
+		osy = _mm256_sub_ps( one, sy );
+		for( k = 0; k + 8 <= count; k += 8 )
+		{
+			__m256i o = _mm256_loadu_si256( (const __m256i*)(cols->offset + k) );
+			__m256i oc = _mm256_add_epi32( o, ch );
+			__m256 sx = _mm256_loadu_ps( cols->fraction + k );
+			__m256 osx = _mm256_sub_ps( one, sx );
+			__m256 a = _mm256_i32gather_ps( row0, o, 4 );
+			__m256 b = _mm256_i32gather_ps( row0, oc, 4 );
+			__m256 c = _mm256_i32gather_ps( row1, o, 4 );
+			__m256 d = _mm256_i32gather_ps( row1, oc, 4 );
+			__m256 value = _mm256_set1_ps( 0.5f );
+			__m128i v;
+			/*	no FMA: the scalar code rounds after every multiply	*/
+			value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( a, osx ), osy ) );
+			value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( b, sx ), osy ) );
+			value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( c, osx ), sy ) );
+			value = _mm256_add_ps( value, _mm256_mul_ps( _mm256_mul_ps( d, sx ), sy ) );
+			{
+				__m256i t = _mm256_cvttps_epi32( value );
+				v = _mm_packus_epi32( _mm256_castsi256_si128( t ), _mm256_extracti128_si256( t, 1 ) );
+				v = _mm_packus_epi16( v, v );
+			}
+			_mm_storel_epi64( (__m128i*)(out + k), v );
+		}
+		for( ; k < count; ++k )
+		{
+			out[k] = up_scale_sample( row0, row1, cols->offset[k], channels, cols->fraction[k], sampley );
+		}
+	}
+}
+
+/*
+	mipmap_image, 2x2 blocks
+	------------------------
+	Each output byte averages bytes 2pC+c and 2pC+C+c of two source rows
+	(pixel p, channel c, C channels).  One step handles as many whole output
+	pixels as fit in 16 bytes, gathering the left and right samples of the
+	32 source bytes behind them with two byte shuffles.
+*/
+typedef struct
+{
+	__m128i left_lo, left_hi, right_lo, right_hi;
+	int src_bytes, dst_bytes;
+} mip_shuffle;
+
+IH_TARGET("sse4.1")
+static void
+	mip_shuffle_setup
+	(
+		mip_shuffle* s,
+		int channels
+	)
+{
+	char left_lo[16], left_hi[16], right_lo[16], right_hi[16];
+	const int pixels = 16 / channels;
+	int k;
+	s->dst_bytes = pixels * channels;
+	s->src_bytes = 2 * s->dst_bytes;
+	for( k = 0; k < 16; ++k )
+	{
+		/*	0x80 zeroes the lane	*/
+		int left = -1, right = -1;
+		if( k < s->dst_bytes )
+		{
+			left = 2*(k / channels)*channels + (k % channels);
+			right = left + channels;
+		}
+		left_lo[k] = (char)((left >= 0 && left < 16) ? left : 0x80);
+		left_hi[k] = (char)((left >= 16) ? left - 16 : 0x80);
+		right_lo[k] = (char)((right >= 0 && right < 16) ? right : 0x80);
+		right_hi[k] = (char)((right >= 16) ? right - 16 : 0x80);
+	}
+	s->left_lo = _mm_loadu_si128( (const __m128i*)left_lo );
+	s->left_hi = _mm_loadu_si128( (const __m128i*)left_hi );
+	s->right_lo = _mm_loadu_si128( (const __m128i*)right_lo );
+	s->right_hi = _mm_loadu_si128( (const __m128i*)right_hi );
+}
+
+/*	the scalar mipmap_image inner loop, u_block quirk included	*/
+static unsigned char
+	mip_sample
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		int block_size_x, int block_size_y,
+		int i, int j, int c
+	)
+{
+	const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+	int sum_value;
+	int u, v;
+	int u_block = block_size_x;
+	int v_block = block_size_y;
+	int block_area;
+	if( block_size_x * (i+1) > width )
+	{
+		u_block = width - i*block_size_y;
+	}
+	if( block_size_y * (j+1) > height )
+	{
+		v_block = height - j*block_size_y;
+	}
+	block_area = u_block*v_block;
+	sum_value = block_area >> 1;
+	for( v = 0; v < v_block; ++v )
+	for( u = 0; u < u_block; ++u )
+	{
+		sum_value += orig[index + v*width*channels + u*channels];
+	}
+	return (unsigned char)(sum_value / block_area);
+}
+
+IH_TARGET("sse4.1")
+static void
+	mipmap_2x2_sse41
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled
+	)
+{
+	const int mip_width = width / 2;
+	const int mip_height = height / 2;
+	const int row_bytes = width * channels;
+	const int mip_row_bytes = mip_width * channels;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16( 2 );
+	mip_shuffle s;
+	int i, j;
+	mip_shuffle_setup( &s, channels );
+	for( j = 0; j < mip_height; ++j )
+	{
+		const unsigned char* row0 = orig + (2*j)*row_bytes;
+		const unsigned char* row1 = row0 + row_bytes;
+		unsigned char* out = resampled + j*mip_row_bytes;
+		int src = 0, dst = 0;
+		/*	the full 16 byte store must stay inside this output row	*/
+		while( (src + 32 <= row_bytes) && (dst + 16 <= mip_row_bytes) )
+		{
+			__m128i a0 = _mm_loadu_si128( (const __m128i*)(row0 + src) );
+			__m128i a1 = _mm_loadu_si128( (const __m128i*)(row0 + src + 16) );
+			__m128i b0 = _mm_loadu_si128( (const __m128i*)(row1 + src) );
+			__m128i b1 = _mm_loadu_si128( (const __m128i*)(row1 + src + 16) );
+			__m128i la = _mm_or_si128( _mm_shuffle_epi8( a0, s.left_lo ), _mm_shuffle_epi8( a1, s.left_hi ) );
+			__m128i ra = _mm_or_si128( _mm_shuffle_epi8( a0, s.right_lo ), _mm_shuffle_epi8( a1, s.right_hi ) );
+			__m128i lb = _mm_or_si128( _mm_shuffle_epi8( b0, s.left_lo ), _mm_shuffle_epi8( b1, s.left_hi ) );
+			__m128i rb = _mm_or_si128( _mm_shuffle_epi8( b0, s.right_lo ), _mm_shuffle_epi8( b1, s.right_hi ) );
+			/*	(2 + four samples) / 4 in 16 bit lanes	*/
+			__m128i lo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8( la, zero ), _mm_unpacklo_epi8( ra, zero ) ),
+										_mm_add_epi16( _mm_unpacklo_epi8( lb, zero ), _mm_unpacklo_epi8( rb, zero ) ) );
+			__m128i hi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8( la, zero ), _mm_unpackhi_epi8( ra, zero ) ),
+										_mm_add_epi16( _mm_unpackhi_epi8( lb, zero ), _mm_unpackhi_epi8( rb, zero ) ) );
+			lo = _mm_srli_epi16( _mm_add_epi16( lo, two ), 2 );
+			hi = _mm_srli_epi16( _mm_add_epi16( hi, two ), 2 );
+			/*	bytes past dst_bytes are rewritten by the next step	*/
+			_mm_storeu_si128( (__m128i*)(out + dst), _mm_packus_epi16( lo, hi ) );
+			src += s.src_bytes;
+			dst += s.dst_bytes;
+		}
+		for( i = dst; i < mip_row_bytes; ++i )
+		{
+			out[i] = mip_sample( orig, width, height, channels, 2, 2, i / channels, j, i % channels );
+		}
+	}
+}
+
+/*
+	scale_image_RGB_to_NTSC_safe
+	----------------------------
+	The LUT entries are recomputed per byte with the same float operations
+	that build the LUT, alpha bytes (channels 2 and 4) are blended back.
+*/
+static const float ntsc_scale_lo = 16.0f - 0.499f;
+static const float ntsc_scale_hi = 235.0f + 0.499f;
+
+IH_TARGET("sse4.1")
+static __m128i
+	ntsc_alpha_mask
+	(
+		int channels
+	)
+{
+	char mask[16];
+	int k;
+	for( k = 0; k < 16; ++k )
+	{
+		mask[k] = (char)((((channels & 1) == 0) && (k % channels == channels - 1)) ? 0xFF : 0);
+	}
+	return _mm_loadu_si128( (const __m128i*)mask );
+}
+
+IH_TARGET("sse4.1")
+static __m128i
+	ntsc_scale4_sse41
+	(
+		__m128i bytes
+	)
+{
+	__m128 f = _mm_cvtepi32_ps( _mm_cvtepu8_epi32( bytes ) );
+	f = _mm_mul_ps( _mm_set1_ps( ntsc_scale_hi - ntsc_scale_lo ), f );
+	f = _mm_div_ps( f, _mm_set1_ps( 255.0f ) );
+	f = _mm_add_ps( f, _mm_set1_ps( ntsc_scale_lo ) );
+	return _mm_cvttps_epi32( f );
+}
+
+IH_TARGET("sse4.1")
+static size_t
+	ntsc_sse41
+	(
+		unsigned char* orig,
+		size_t total, int channels
+	)
+{
+	const __m128i alpha = ntsc_alpha_mask( channels );
+	size_t i;
+	/*	16 bytes hold whole pixels for 1, 2 and 4 channels, and 3 has no alpha	*/
+	for( i = 0; i + 16 <= total; i += 16 )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		__m128i lo = _mm_packus_epi32( ntsc_scale4_sse41( x ), ntsc_scale4_sse41( _mm_srli_si128( x, 4 ) ) );
+		__m128i hi = _mm_packus_epi32( ntsc_scale4_sse41( _mm_srli_si128( x, 8 ) ), ntsc_scale4_sse41( _mm_srli_si128( x, 12 ) ) );
+		__m128i scaled = _mm_packus_epi16( lo, hi );
+		_mm_storeu_si128( (__m128i*)(orig + i), _mm_blendv_epi8( scaled, x, alpha ) );
+	}
+	return i;
+}
+
+IH_TARGET("avx2")
+static __m256i
+	ntsc_scale8_avx2
+	(
+		__m128i bytes
+	)
+{
+	__m256 f = _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( bytes ) );
+	f = _mm256_mul_ps( _mm256_set1_ps( ntsc_scale_hi - ntsc_scale_lo ), f );
+	f = _mm256_div_ps( f, _mm256_set1_ps( 255.0f ) );
+	f = _mm256_add_ps( f, _mm256_set1_ps( ntsc_scale_lo ) );
+	return _mm256_cvttps_epi32( f );
+}
+
+IH_TARGET("avx2")
+static size_t
+	ntsc_avx2
+	(
+		unsigned char* orig,
+		size_t total, int channels
+	)
+{
+	const __m128i alpha = ntsc_alpha_mask( channels );
+	size_t i;
+	for( i = 0; i + 16 <= total; i += 16 )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		/*	in-lane pack gives 0-3 8-11 4-7 12-15, the permute restores the order	*/
+		__m256i words = _mm256_packus_epi32( ntsc_scale8_avx2( x ), ntsc_scale8_avx2( _mm_srli_si128( x, 8 ) ) );
+		__m128i scaled;
+		words = _mm256_permute4x64_epi64( words, 0xD8 );
+		scaled = _mm_packus_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) );
+		_mm_storeu_si128( (__m128i*)(orig + i), _mm_blendv_epi8( scaled, x, alpha ) );
+	}
+	return i;
+}
+
+/*
+	YCoCg conversions
+	-----------------
+	Byte shuffles spread each channel of 4 pixels (per 128 bit lane) into
+	32 bit lanes, the integer maths is the scalar maths (arithmetic shifts
+	included), and saturating packs do exactly what clamp_byte does.
+*/
+#define IH_SPREAD(c0,c1,c2,c3)	c0,-1,-1,-1, c1,-1,-1,-1, c2,-1,-1,-1, c3,-1,-1,-1
+
+IH_TARGET("sse4.1")
+static __m128i
+	ih_mask
+	(
+		const char* bytes
+	)
+{
+	return _mm_loadu_si128( (const __m128i*)bytes );
+}
+
+static const char spread4[4][16] = {
+	{ IH_SPREAD(0,4,8,12) }, { IH_SPREAD(1,5,9,13) }, { IH_SPREAD(2,6,10,14) }, { IH_SPREAD(3,7,11,15) }
+};
+static const char spread3[3][16] = {
+	{ IH_SPREAD(0,3,6,9) }, { IH_SPREAD(1,4,7,10) }, { IH_SPREAD(2,5,8,11) }
+};
+/*	planar 4x4 bytes back to interleaved pixels	*/
+static const char interleave4[16] = { 0,4,8,12, 1,5,9,13, 2,6,10,14, 3,7,11,15 };
+static const char interleave3[16] = { 0,4,8, 1,5,9, 2,6,10, 3,7,11, -1,-1,-1,-1 };
+
+IH_TARGET("sse4.1")
+static void
+	store12
+	(
+		unsigned char* out,
+		__m128i v
+	)
+{
+	int last = _mm_extract_epi32( v, 2 );
+	_mm_storel_epi64( (__m128i*)out, v );
+	memcpy( out + 8, &last, 4 );
+}
+
+IH_TARGET("sse4.1")
+static size_t
+	rgb_to_ycocg_sse41
+	(
+		unsigned char* orig,
+		size_t total, int channels
+	)
+{
+	const __m128i one = _mm_set1_epi32( 1 );
+	const __m128i two = _mm_set1_epi32( 2 );
+	const __m128i half = _mm_set1_epi32( 128 );
+	const __m128i sr = ih_mask( spread4[0] ), sg = ih_mask( spread4[1] ), sb = ih_mask( spread4[2] ), sa = ih_mask( spread4[3] );
+	const __m128i sr3 = ih_mask( spread3[0] ), sg3 = ih_mask( spread3[1] ), sb3 = ih_mask( spread3[2] );
+	const __m128i inter4 = ih_mask( interleave4 ), inter3 = ih_mask( interleave3 );
+	/*	3 channels consume 12 of the 16 loaded bytes	*/
+	const size_t step = (size_t)channels * 4;
+	size_t i;
+	for( i = 0; i + 16 <= total; i += step )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		__m128i r = _mm_shuffle_epi8( x, channels == 4 ? sr : sr3 );
+		__m128i g = _mm_shuffle_epi8( x, channels == 4 ? sg : sg3 );
+		__m128i b = _mm_shuffle_epi8( x, channels == 4 ? sb : sb3 );
+		__m128i tmp, co, y, cg;
+		g = _mm_srai_epi32( _mm_add_epi32( g, one ), 1 );
+		tmp = _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( two, r ), b ), 2 );
+		co = _mm_add_epi32( half, _mm_srai_epi32( _mm_add_epi32( _mm_sub_epi32( r, b ), one ), 1 ) );
+		y = _mm_add_epi32( g, tmp );
+		cg = _mm_sub_epi32( _mm_add_epi32( half, g ), tmp );
+		if( channels == 4 )
+		{
+			/*	CoCgAY	*/
+			__m128i a = _mm_shuffle_epi8( x, sa );
+			__m128i planar = _mm_packus_epi16( _mm_packs_epi32( co, cg ), _mm_packs_epi32( a, y ) );
+			_mm_storeu_si128( (__m128i*)(orig + i), _mm_shuffle_epi8( planar, inter4 ) );
+		} else
+		{
+			/*	CoYCg	*/
+			__m128i planar = _mm_packus_epi16( _mm_packs_epi32( co, y ), _mm_packs_epi32( cg, cg ) );
+			store12( orig + i, _mm_shuffle_epi8( planar, inter3 ) );
+		}
+	}
+	return i;
+}
+
+IH_TARGET("sse4.1")
+static size_t
+	ycocg_to_rgb_sse41
+	(
+		unsigned char* orig,
+		size_t total, int channels
+	)
+{
+	const __m128i half = _mm_set1_epi32( 128 );
+	const __m128i s0 = ih_mask( spread4[0] ), s1 = ih_mask( spread4[1] ), s2 = ih_mask( spread4[2] ), s3 = ih_mask( spread4[3] );
+	const __m128i s0_3 = ih_mask( spread3[0] ), s1_3 = ih_mask( spread3[1] ), s2_3 = ih_mask( spread3[2] );
+	const __m128i inter4 = ih_mask( interleave4 ), inter3 = ih_mask( interleave3 );
+	const size_t step = (size_t)channels * 4;
+	size_t i;
+	for( i = 0; i + 16 <= total; i += step )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		__m128i co, cg, y, r, g, b;
+		if( channels == 4 )
+		{
+			co = _mm_sub_epi32( _mm_shuffle_epi8( x, s0 ), half );
+			cg = _mm_sub_epi32( _mm_shuffle_epi8( x, s1 ), half );
+			y = _mm_shuffle_epi8( x, s3 );
+		} else
+		{
+			co = _mm_sub_epi32( _mm_shuffle_epi8( x, s0_3 ), half );
+			y = _mm_shuffle_epi8( x, s1_3 );
+			cg = _mm_sub_epi32( _mm_shuffle_epi8( x, s2_3 ), half );
+		}
+		r = _mm_sub_epi32( _mm_add_epi32( y, co ), cg );
+		g = _mm_add_epi32( y, cg );
+		b = _mm_sub_epi32( _mm_sub_epi32( y, co ), cg );
+		if( channels == 4 )
+		{
+			__m128i a = _mm_shuffle_epi8( x, s2 );
+			__m128i planar = _mm_packus_epi16( _mm_packs_epi32( r, g ), _mm_packs_epi32( b, a ) );
+			_mm_storeu_si128( (__m128i*)(orig + i), _mm_shuffle_epi8( planar, inter4 ) );
+		} else
+		{
+			__m128i planar = _mm_packus_epi16( _mm_packs_epi32( r, g ), _mm_packs_epi32( b, b ) );
+			store12( orig + i, _mm_shuffle_epi8( planar, inter3 ) );
+		}
+	}
+	return i;
+}
+
+/*	AVX2 runs the same lane-wise code on 8 RGBA pixels, 3 channels stay on SSE4.1	*/
+IH_TARGET("avx2")
+static __m256i
+	ih_mask2
+	(
+		const char* bytes
+	)
+{
+	return _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)bytes ) );
+}
+
+IH_TARGET("avx2")
+static size_t
+	rgb_to_ycocg_avx2
+	(
+		unsigned char* orig,
+		size_t total
+	)
+{
+	const __m256i one = _mm256_set1_epi32( 1 );
+	const __m256i two = _mm256_set1_epi32( 2 );
+	const __m256i half = _mm256_set1_epi32( 128 );
+	const __m256i sr = ih_mask2( spread4[0] ), sg = ih_mask2( spread4[1] ), sb = ih_mask2( spread4[2] ), sa = ih_mask2( spread4[3] );
+	const __m256i inter4 = ih_mask2( interleave4 );
+	size_t i;
+	for( i = 0; i + 32 <= total; i += 32 )
+	{
+		__m256i x = _mm256_loadu_si256( (const __m256i*)(orig + i) );
+		__m256i r = _mm256_shuffle_epi8( x, sr );
+		__m256i g = _mm256_shuffle_epi8( x, sg );
+		__m256i b = _mm256_shuffle_epi8( x, sb );
+		__m256i a = _mm256_shuffle_epi8( x, sa );
+		__m256i tmp, co, y, cg, planar;
+		g = _mm256_srai_epi32( _mm256_add_epi32( g, one ), 1 );
+		tmp = _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32( two, r ), b ), 2 );
+		co = _mm256_add_epi32( half, _mm256_srai_epi32( _mm256_add_epi32( _mm256_sub_epi32( r, b ), one ), 1 ) );
+		y = _mm256_add_epi32( g, tmp );
+		cg = _mm256_sub_epi32( _mm256_add_epi32( half, g ), tmp );
+		planar = _mm256_packus_epi16( _mm256_packs_epi32( co, cg ), _mm256_packs_epi32( a, y ) );
+		_mm256_storeu_si256( (__m256i*)(orig + i), _mm256_shuffle_epi8( planar, inter4 ) );
+	}
+	return i;
+}
+
+IH_TARGET("avx2")
+static size_t
+	ycocg_to_rgb_avx2
+	(
+		unsigned char* orig,
+		size_t total
+	)
+{
+	const __m256i half = _mm256_set1_epi32( 128 );
+	const __m256i s0 = ih_mask2( spread4[0] ), s1 = ih_mask2( spread4[1] ), s2 = ih_mask2( spread4[2] ), s3 = ih_mask2( spread4[3] );
+	const __m256i inter4 = ih_mask2( interleave4 );
+	size_t i;
+	for( i = 0; i + 32 <= total; i += 32 )
+	{
+		__m256i x = _mm256_loadu_si256( (const __m256i*)(orig + i) );
+		__m256i co = _mm256_sub_epi32( _mm256_shuffle_epi8( x, s0 ), half );
+		__m256i cg = _mm256_sub_epi32( _mm256_shuffle_epi8( x, s1 ), half );
+		__m256i a = _mm256_shuffle_epi8( x, s2 );
+		__m256i y = _mm256_shuffle_epi8( x, s3 );
+		__m256i r = _mm256_sub_epi32( _mm256_add_epi32( y, co ), cg );
+		__m256i g = _mm256_add_epi32( y, cg );
+		__m256i b = _mm256_sub_epi32( _mm256_sub_epi32( y, co ), cg );
+		__m256i planar = _mm256_packus_epi16( _mm256_packs_epi32( r, g ), _mm256_packs_epi32( b, a ) );
+		_mm256_storeu_si256( (__m256i*)(orig + i), _mm256_shuffle_epi8( planar, inter4 ) );
+	}
+	return i;
+}
+
+#endif /* IH_X86	*/
+
+int
+	up_scale_image_simd
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height
+	)
+{
+#if IH_X86
+	const int level = image_helper_simd_level();
+	up_scale_columns cols;
+	/*	a 1 pixel wide or high source reads outside the image in the
+		scalar code too, leave those (and errors) to it	*/
+	if( (level > IMAGE_HELPER_SCALAR) &&
+		(width >= 2) && (height >= 2) &&
+		(resampled_width >= 2) && (resampled_height >= 2) &&
+		(channels >= 1) && (orig != NULL) && (resampled != NULL) &&
+		up_scale_setup( &cols, width, channels, resampled_width ) )
+	{
+		if( level >= IMAGE_HELPER_AVX2 )
+		{
+			up_scale_rows_avx2( orig, width, height, channels, resampled, resampled_width, resampled_height, &cols );
+		} else
+		{
+			up_scale_rows_sse41( orig, width, height, channels, resampled, resampled_width, resampled_height, &cols );
+		}
+		up_scale_release( &cols );
+		return 1;
+	}
+#endif
+	return up_scale_image( orig, width, height, channels, resampled, resampled_width, resampled_height );
+}
+
+int
+	mipmap_image_simd
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+#if IH_X86
+	/*	only 2x2 blocks without partial edge blocks are vectorized	*/
+	if( (image_helper_simd_level() > IMAGE_HELPER_SCALAR) &&
+		(block_size_x == 2) && (block_size_y == 2) &&
+		(width >= 2) && (height >= 2) &&
+		(channels >= 1) && (channels <= 4) &&
+		(orig != NULL) && (resampled != NULL) )
+	{
+		mipmap_2x2_sse41( orig, width, height, channels, resampled );
+		return 1;
+	}
+#endif
+	return mipmap_image( orig, width, height, channels, resampled, block_size_x, block_size_y );
+}
+
+int
+	scale_image_RGB_to_NTSC_safe_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+#if IH_X86
+	const int level = image_helper_simd_level();
+	if( (level > IMAGE_HELPER_SCALAR) &&
+		(width >= 1) && (height >= 1) &&
+		(channels >= 1) && (channels <= 4) && (orig != NULL) )
+	{
+		const size_t total = (size_t)width * height * channels;
+		size_t done = (level >= IMAGE_HELPER_AVX2) ? ntsc_avx2( orig, total, channels )
+												   : ntsc_sse41( orig, total, channels );
+		/*	the scalar code finishes the rest: done is a whole number of pixels
+			for 2 and 4 channels, while 1 and 3 treat every byte the same	*/
+		if( done < total )
+		{
+			if( channels & 1 )
+			{
+				scale_image_RGB_to_NTSC_safe( orig + done, (int)(total - done), 1, 1 );
+			} else
+			{
+				scale_image_RGB_to_NTSC_safe( orig + done, (int)((total - done) / channels), 1, channels );
+			}
+		}
+		return 1;
+	}
+#endif
+	return scale_image_RGB_to_NTSC_safe( orig, width, height, channels );
+}
+
+int
+	convert_RGB_to_YCoCg_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+#if IH_X86
+	const int level = image_helper_simd_level();
+	if( (level > IMAGE_HELPER_SCALAR) &&
+		(width >= 1) && (height >= 1) &&
+		(channels >= 3) && (channels <= 4) && (orig != NULL) )
+	{
+		const size_t total = (size_t)width * height * channels;
+		size_t done = 0;
+		if( (level >= IMAGE_HELPER_AVX2) && (channels == 4) )
+		{
+			done = rgb_to_ycocg_avx2( orig, total );
+		}
+		done += rgb_to_ycocg_sse41( orig + done, total - done, channels );
+		if( done < total )
+		{
+			convert_RGB_to_YCoCg( orig + done, (int)((total - done) / channels), 1, channels );
+		}
+		return 0;
+	}
+#endif
+	return convert_RGB_to_YCoCg( orig, width, height, channels );
+}
+
+int
+	convert_YCoCg_to_RGB_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	)
+{
+#if IH_X86
+	const int level = image_helper_simd_level();
+	if( (level > IMAGE_HELPER_SCALAR) &&
+		(width >= 1) && (height >= 1) &&
+		(channels >= 3) && (channels <= 4) && (orig != NULL) )
+	{
+		const size_t total = (size_t)width * height * channels;
+		size_t done = 0;
+		if( (level >= IMAGE_HELPER_AVX2) && (channels == 4) )
+		{
+			done = ycocg_to_rgb_avx2( orig, total );
+		}
+		done += ycocg_to_rgb_sse41( orig + done, total - done, channels );
+		if( done < total )
+		{
+			convert_YCoCg_to_RGB( orig + done, (int)((total - done) / channels), 1, channels );
+		}
+		return 0;
+	}
+#endif
+	return convert_YCoCg_to_RGB( orig, width, height, channels );
+}
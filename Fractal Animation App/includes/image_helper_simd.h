@@ -0,0 +1,97 @@
+/*
+    SIMD image helper functions
+
+    Drop-in versions of the image_helper.h routines using SSE4.1 or AVX2,
+    picked at runtime from what the CPU supports.  Every function returns
+    exactly the same bytes (and the same return value) as its scalar
+    counterpart, anything they do not vectorize falls back to it.
+
+    MIT license
+*/
+
+#ifndef HEADER_IMAGE_HELPER_SIMD
+#define HEADER_IMAGE_HELPER_SIMD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Instruction sets the _simd functions can use.
+**/
+enum
+{
+	IMAGE_HELPER_SCALAR = 0,
+	IMAGE_HELPER_SSE41 = 1,
+	IMAGE_HELPER_AVX2 = 2
+};
+
+/**
+	The instruction set the _simd functions currently use,
+	the best one the CPU supports unless it was lowered.
+**/
+int
+	image_helper_simd_level
+	(
+		void
+	);
+
+/**
+	Lowers (or restores) the instruction set used, clamped to
+	what the CPU supports.  Meant for benchmarks and tests.
+**/
+void
+	image_helper_simd_set_level
+	(
+		int level
+	);
+
+/**	see up_scale_image	**/
+int
+	up_scale_image_simd
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height
+	);
+
+/**	see mipmap_image, only 2x2 blocks are vectorized	**/
+int
+	mipmap_image_simd
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	);
+
+/**	see scale_image_RGB_to_NTSC_safe	**/
+int
+	scale_image_RGB_to_NTSC_safe_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	);
+
+/**	see convert_RGB_to_YCoCg	**/
+int
+	convert_RGB_to_YCoCg_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	);
+
+/**	see convert_YCoCg_to_RGB	**/
+int
+	convert_YCoCg_to_RGB_simd
+	(
+		unsigned char* orig,
+		int width, int height, int channels
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_HELPER_SIMD	*/
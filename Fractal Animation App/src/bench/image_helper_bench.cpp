@@ -0,0 +1,120 @@
+// Times the image_helper routines against their SIMD versions on 4K images and
+// checks that both produce the same bytes.
+//
+// usage: image_helper_bench [repetitions]
+
+#include <image_helper.h>
+#include <image_helper_simd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const int WIDTH = 3840;
+    const int HEIGHT = 2160;
+    const char* LEVEL_NAMES[] = { "scalar", "SSE4.1", "AVX2" };
+
+    // best of the repetitions in milliseconds, setup (restoring the input) is not timed
+    double timeBest(int repetitions, const std::function<void()>& setup, const std::function<void()>& run)
+    {
+        double best = 1e30;
+        for (int i = 0; i < repetitions; i++)
+        {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            run();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    struct Case
+    {
+        const char* name;
+        int channels;
+        size_t outputSize;
+        // runs the routine on input into output, simd selects the version
+        std::function<void(const std::vector<unsigned char>& input, std::vector<unsigned char>& output, bool simd)> run;
+        bool inPlace;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    int repetitions = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+    const int best = image_helper_simd_level();
+    printf("%dx%d, best of %d, cpu supports %s\n\n", WIDTH, HEIGHT, repetitions, LEVEL_NAMES[best]);
+
+    std::mt19937 random(330);
+    std::vector<unsigned char> rgb((size_t)WIDTH * HEIGHT * 3), rgba((size_t)WIDTH * HEIGHT * 4);
+    for (unsigned char& value : rgb)
+        value = (unsigned char)random();
+    for (unsigned char& value : rgba)
+        value = (unsigned char)random();
+    // the up-scale source is a quarter size image scaled up to 4K
+    const int smallWidth = WIDTH / 2, smallHeight = HEIGHT / 2;
+    std::vector<unsigned char> smallRgba((size_t)smallWidth * smallHeight * 4);
+    for (unsigned char& value : smallRgba)
+        value = (unsigned char)random();
+
+    std::vector<Case> cases;
+    for (int channels : { 3, 4 })
+    {
+        const std::vector<unsigned char>& source = channels == 3 ? rgb : rgba;
+        cases.push_back({ channels == 3 ? "RGB_to_NTSC_safe  RGB " : "RGB_to_NTSC_safe  RGBA", channels, source.size(),
+            [channels](const std::vector<unsigned char>&, std::vector<unsigned char>& out, bool simd)
+            { simd ? scale_image_RGB_to_NTSC_safe_simd(out.data(), WIDTH, HEIGHT, channels) : scale_image_RGB_to_NTSC_safe(out.data(), WIDTH, HEIGHT, channels); }, true });
+        cases.push_back({ channels == 3 ? "RGB_to_YCoCg      RGB " : "RGB_to_YCoCg      RGBA", channels, source.size(),
+            [channels](const std::vector<unsigned char>&, std::vector<unsigned char>& out, bool simd)
+            { simd ? convert_RGB_to_YCoCg_simd(out.data(), WIDTH, HEIGHT, channels) : convert_RGB_to_YCoCg(out.data(), WIDTH, HEIGHT, channels); }, true });
+        cases.push_back({ channels == 3 ? "YCoCg_to_RGB      RGB " : "YCoCg_to_RGB      RGBA", channels, source.size(),
+            [channels](const std::vector<unsigned char>&, std::vector<unsigned char>& out, bool simd)
+            { simd ? convert_YCoCg_to_RGB_simd(out.data(), WIDTH, HEIGHT, channels) : convert_YCoCg_to_RGB(out.data(), WIDTH, HEIGHT, channels); }, true });
+        cases.push_back({ channels == 3 ? "mipmap 2x2        RGB " : "mipmap 2x2        RGBA", channels, (size_t)(WIDTH / 2) * (HEIGHT / 2) * channels,
+            [channels](const std::vector<unsigned char>& in, std::vector<unsigned char>& out, bool simd)
+            { simd ? mipmap_image_simd(in.data(), WIDTH, HEIGHT, channels, out.data(), 2, 2) : mipmap_image(in.data(), WIDTH, HEIGHT, channels, out.data(), 2, 2); }, false });
+    }
+    cases.push_back({ "up_scale x2       RGBA", 4, rgba.size(),
+        [&smallRgba](const std::vector<unsigned char>&, std::vector<unsigned char>& out, bool simd)
+        { simd ? up_scale_image_simd(smallRgba.data(), smallWidth, smallHeight, 4, out.data(), WIDTH, HEIGHT)
+               : up_scale_image(smallRgba.data(), smallWidth, smallHeight, 4, out.data(), WIDTH, HEIGHT); }, false });
+
+    printf("%-24s %10s", "", "scalar ms");
+    for (int level = IMAGE_HELPER_SSE41; level <= best; level++)
+        printf(" %10s ms %8s", LEVEL_NAMES[level], "speedup");
+    printf("\n");
+
+    bool identical = true;
+    for (const Case& test : cases)
+    {
+        const std::vector<unsigned char>& input = test.channels == 3 ? rgb : rgba;
+        std::vector<unsigned char> expected(test.outputSize), output(test.outputSize);
+        auto setup = [&](std::vector<unsigned char>& out)
+        {
+            if (test.inPlace)
+                out = input;
+        };
+
+        double scalar = timeBest(repetitions, [&] { setup(expected); }, [&] { test.run(input, expected, false); });
+        printf("%-24s %10.2f", test.name, scalar);
+        for (int level = IMAGE_HELPER_SSE41; level <= best; level++)
+        {
+            image_helper_simd_set_level(level);
+            double simd = timeBest(repetitions, [&] { setup(output); }, [&] { test.run(input, output, true); });
+            bool same = output == expected;
+            identical = identical && same;
+            printf(" %13.2f %7.2fx%s", simd, scalar / simd, same ? "" : " MISMATCH");
+        }
+        image_helper_simd_set_level(best);
+        printf("\n");
+    }
+    printf("\n%s\n", identical ? "all results identical" : "results differ!");
+    return identical ? 0 : 1;
+}
@@ -1,12 +1,13 @@
 #version 330 core
 in vec2 TexCoords;
+in vec4 TextColor;
 out vec4 color;
 
 uniform sampler2D text;
-uniform vec3 textColor;
 
 void main()
-{    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-    color = vec4(textColor, 1.0) * sampled;
-}  
\ No newline at end of file
+{
+    // every glyph lives in the same atlas, the color comes with the vertices
+    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords / vec2(textureSize(text, 0))).r);
+    color = TextColor * sampled;
+}
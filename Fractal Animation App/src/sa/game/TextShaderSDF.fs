@@ -0,0 +1,16 @@
+#version 330 core
+in vec2 TexCoords;
+in vec4 TextColor;
+out vec4 color;
+
+uniform sampler2D text;
+
+void main()
+{
+    // the atlas holds distances, 0.5 is the outline. the edge is smoothed over about
+    // one screen pixel whatever the text scale
+    float distance = texture(text, TexCoords / vec2(textureSize(text, 0))).r;
+    float width = max(fwidth(distance) * 0.7, 1e-4);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    color = vec4(TextColor.rgb, TextColor.a * alpha);
+}
@@ -0,0 +1,153 @@
+// Baked animation curves and their bulk evaluation, see anim_curves.h
+
+#include "anim_curves.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIM_CURVES_SSE2
+#endif
+
+namespace
+{
+    // largest float below SAMPLES, wrapped positions are clamped to it so rounding can never index past the table
+    const float LAST_POSITION = std::nextafter((float)AnimCurve::SAMPLES, 0.0f);
+
+    // instances per task when a timeline is split across the thread pool
+    const size_t BLOCK = 16384;
+
+#ifdef ANIM_CURVES_SSE2
+    // SSE2 has no floor, truncate and step down where truncation rounded up
+    inline __m128 floor4(__m128 x)
+    {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+    }
+#endif
+}
+
+AnimCurve::AnimCurve()
+{
+    std::fill(table, table + SAMPLES + 1, 0.0f);
+}
+
+AnimCurve AnimCurve::Procedural(const std::function<float(float)>& f, float period)
+{
+    AnimCurve curve;
+    curve.period = period;
+    for (int i = 0; i < SAMPLES; i++)
+        curve.table[i] = f(period * i / SAMPLES);
+    curve.table[SAMPLES] = curve.table[0];
+    return curve;
+}
+
+AnimCurve AnimCurve::Keyframed(const std::vector<CurveKey>& keys, float period)
+{
+    if (keys.empty())
+        return AnimCurve();
+    return Procedural([&keys, period](float t)
+    {
+        // first key after t, the segment before it contains t
+        size_t next = 0;
+        while (next < keys.size() && keys[next].time <= t)
+            next++;
+        CurveKey a = next == 0 ? keys.back() : keys[next - 1];
+        CurveKey b = next == keys.size() ? keys.front() : keys[next];
+        // unwrap the segment that crosses the end of the period
+        if (a.time > t)
+            a.time -= period;
+        if (b.time <= a.time)
+            b.time += period;
+        float span = b.time - a.time;
+        return span > 0.0f ? a.value + (b.value - a.value) * (t - a.time) / span : a.value;
+    }, period);
+}
+
+float AnimCurve::Evaluate(float time) const
+{
+    float phase = 0.0f;
+    float value;
+    EvaluateBulk(time, &phase, &value, 1);
+    return value;
+}
+
+void AnimCurve::EvaluateBulk(float time, const float* phases, float* out, size_t count) const
+{
+    const float scale = SAMPLES / period;
+    const float invSamples = 1.0f / SAMPLES;
+    size_t i = 0;
+#ifdef ANIM_CURVES_SSE2
+    const __m128 vTime = _mm_set1_ps(time);
+    const __m128 vScale = _mm_set1_ps(scale);
+    const __m128 vSamples = _mm_set1_ps((float)SAMPLES);
+    const __m128 vInvSamples = _mm_set1_ps(invSamples);
+    const __m128 vLast = _mm_set1_ps(LAST_POSITION);
+    for (; i + 4 <= count; i += 4)
+    {
+        // table position, wrapped into [0, SAMPLES)
+        __m128 u = _mm_mul_ps(_mm_add_ps(vTime, _mm_loadu_ps(phases + i)), vScale);
+        u = _mm_sub_ps(u, _mm_mul_ps(floor4(_mm_mul_ps(u, vInvSamples)), vSamples));
+        u = _mm_min_ps(_mm_max_ps(u, _mm_setzero_ps()), vLast);
+        __m128 whole = floor4(u);
+        __m128 frac = _mm_sub_ps(u, whole);
+
+        // SSE2 has no gather, the four lookups are scalar loads
+        alignas(16) int index[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(whole));
+        __m128 a = _mm_setr_ps(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+        __m128 b = _mm_setr_ps(table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1]);
+        _mm_storeu_ps(out + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac)));
+    }
+#endif
+    // the same operations one instance at a time, for the tail and non-SSE builds
+    for (; i < count; i++)
+    {
+        float u = (time + phases[i]) * scale;
+        u = u - std::floor(u * invSamples) * (float)SAMPLES;
+        u = std::min(std::max(u, 0.0f), LAST_POSITION);
+        float whole = std::floor(u);
+        float frac = u - whole;
+        int index = (int)whole;
+        float a = table[index];
+        float b = table[index + 1];
+        out[i] = a + (b - a) * frac;
+    }
+}
+
+int AnimTimeline::AddChannel(const AnimCurve& curve)
+{
+    curves.push_back(curve);
+    values.emplace_back(phases.size(), 0.0f);
+    return (int)curves.size() - 1;
+}
+
+void AnimTimeline::SetPhases(const std::vector<float>& phases)
+{
+    this->phases = phases;
+    for (std::vector<float>& channel : values)
+        channel.assign(phases.size(), 0.0f);
+}
+
+void AnimTimeline::Evaluate(float time)
+{
+    size_t count = phases.size();
+    if (count <= BLOCK)
+    {
+        // small timelines are cheaper than waking the pool
+        for (size_t c = 0; c < curves.size(); c++)
+            curves[c].EvaluateBulk(time, phases.data(), values[c].data(), count);
+        return;
+    }
+    int blocks = (int)((count + BLOCK - 1) / BLOCK);
+    ThreadPool::Shared().ParallelFor(blocks, [&](int block)
+    {
+        size_t first = (size_t)block * BLOCK;
+        size_t n = std::min(BLOCK, count - first);
+        for (size_t c = 0; c < curves.size(); c++)
+            curves[c].EvaluateBulk(time, phases.data() + first, values[c].data() + first, n);
+    });
+}
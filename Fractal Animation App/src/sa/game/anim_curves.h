@@ -0,0 +1,68 @@
+#ifndef ANIM_CURVES_H
+#define ANIM_CURVES_H
+///////////////////////////////////////////////////////////////////////////////
+// anim_curves.h
+// =============
+// Looping parameter curves (colors, angles, scales) baked into lookup tables.
+//
+// A curve is given either as a function of time or as keyframes and sampled
+// once into SAMPLES+1 values over its period. Evaluating it is then a wrap,
+// one table lookup and a lerp, which EvaluateBulk does four instances at a
+// time with SSE. AnimTimeline holds a set of curves plus one phase offset per
+// instance and evaluates every curve for every instance each frame, splitting
+// large instance counts across the shared thread pool.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+struct CurveKey
+{
+    float time;
+    float value;
+};
+
+class AnimCurve
+{
+public:
+    static const int SAMPLES = 256;
+
+    AnimCurve();
+
+    // samples f over [0, period), f does not have to be cheap, it only runs while baking
+    static AnimCurve Procedural(const std::function<float(float)>& f, float period);
+    // keys sorted by time inside [0, period), linear in between and wrapping from the last key to the first
+    static AnimCurve Keyframed(const std::vector<CurveKey>& keys, float period);
+
+    float Period() const { return period; }
+    float Evaluate(float time) const;
+    // out[i] = Evaluate(time + phases[i]), bit for bit the same as the scalar path
+    void EvaluateBulk(float time, const float* phases, float* out, size_t count) const;
+
+private:
+    float period = 1.0f;
+    float table[SAMPLES + 1];   // the last entry repeats the first so lerping never wraps
+};
+
+class AnimTimeline
+{
+public:
+    // returns the channel the curve's values are written to
+    int AddChannel(const AnimCurve& curve);
+    // one phase offset in seconds per instance, shared by all channels
+    void SetPhases(const std::vector<float>& phases);
+    size_t InstanceCount() const { return phases.size(); }
+
+    // evaluates every channel for every instance at the given time
+    void Evaluate(float time);
+    // values of a channel from the last Evaluate, one per instance
+    const float* Values(int channel) const { return values[channel].data(); }
+
+private:
+    std::vector<AnimCurve> curves;
+    std::vector<float> phases;
+    std::vector<std::vector<float>> values;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#version 330 core
+
+out vec4 color;
+
+in vec2 texCoord;
+in vec3 normal;
+flat in vec4 atlasRect;
+flat in float atlasLayer;
+
+uniform sampler2DArray textureArray;
+uniform vec3 spriteColor;
+
+void main()
+{
+	// repeat inside the rect; the gradients come from the unwrapped coordinates so mips do not jump at the seams
+	vec2 uv = atlasRect.xy + fract(texCoord) * atlasRect.zw;
+	vec2 dx = dFdx(texCoord) * atlasRect.zw;
+	vec2 dy = dFdy(texCoord) * atlasRect.zw;
+	color = vec4(spriteColor, 1.0) * textureGrad(textureArray, vec3(uv, atlasLayer), dx, dy);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in vec4 aAtlasRect;   // u, v offset and size inside the layer
+layout (location = 8) in float aAtlasLayer;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 texCoord;
+out vec3 normal;
+flat out vec4 atlasRect;
+flat out float atlasLayer;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	normal = mat3(model) * aNormal;
+	texCoord = aTexCoords;
+	atlasRect = aAtlasRect;
+	atlasLayer = aAtlasLayer;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D iterations;
+uniform float zoom;
+uniform float time;
+
+void main()
+{
+	// zoom into the last finished render while the next one is computed
+	float n = texture(iterations, 0.5 + (TexCoords - 0.5) * zoom).r;
+	if (n < 0.0)
+	{
+		FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+	// cycle a cosine palette over time
+	float t = n * 0.02 + time * 0.1;
+	FragColor = vec4(0.5 + 0.5 * cos(6.28318 * (t + vec3(0.0, 0.33, 0.67))), 1.0);
+}
\ No newline at end of file
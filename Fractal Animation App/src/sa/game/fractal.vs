@@ -0,0 +1,11 @@
+#version 330 core
+out vec2 TexCoords;
+
+void main()
+{
+	// fullscreen triangle, no vertex buffer needed
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	TexCoords = pos;
+	// z = w puts it on the far plane like the skybox
+	gl_Position = vec4(pos * 2.0 - 1.0, 1.0, 1.0);
+}
\ No newline at end of file
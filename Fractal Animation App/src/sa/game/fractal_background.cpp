@@ -0,0 +1,399 @@
+// Deep-zoom escape-time fractal background, see fractal_background.h
+//
+// Perturbation: every pixel c = C + dc is iterated as a small delta from the
+// reference orbit Z of the view center C:
+//     z = Z + d,   d' = 2 Z d + d^2 + dc
+// d and dc stay tiny, so plain doubles are enough even when C itself needs
+// ~30 digits. Series approximation expands d after n steps as
+//     d_n = A_n dc + B_n dc^2 + C_n dc^3
+// which lets every pixel start at iteration n instead of 0.
+
+#include "fractal_background.h"
+#include "hash.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+///////////////////////////////////////////////////////////////////////////////
+// double-double arithmetic
+///////////////////////////////////////////////////////////////////////////////
+static inline DoubleDouble quickTwoSum(double a, double b)
+{
+    double s = a + b;
+    return { s, b - (s - a) };
+}
+
+static inline DoubleDouble twoSum(double a, double b)
+{
+    double s = a + b;
+    double bb = s - a;
+    return { s, (a - (s - bb)) + (b - bb) };
+}
+
+DoubleDouble ddFromDouble(double value)
+{
+    return { value, 0.0 };
+}
+
+DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    DoubleDouble t = twoSum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quickTwoSum(s.hi, s.lo);
+    s.lo += t.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+DoubleDouble ddSub(DoubleDouble a, DoubleDouble b)
+{
+    return ddAdd(a, { -b.hi, -b.lo });
+}
+
+DoubleDouble ddMul(DoubleDouble a, DoubleDouble b)
+{
+    double p = a.hi * b.hi;
+    double e = std::fma(a.hi, b.hi, -p);
+    e += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p, e);
+}
+
+DoubleDouble ddDiv(DoubleDouble a, DoubleDouble b)
+{
+    // three rounds of long division are enough for full double-double precision
+    double q1 = a.hi / b.hi;
+    DoubleDouble r = ddSub(a, ddMul(b, ddFromDouble(q1)));
+    double q2 = r.hi / b.hi;
+    r = ddSub(r, ddMul(b, ddFromDouble(q2)));
+    double q3 = r.hi / b.hi;
+    DoubleDouble q = quickTwoSum(q1, q2);
+    return ddAdd(q, ddFromDouble(q3));
+}
+
+// parses "[-]digits[.digits][e[-]digits]" without losing digits to a double conversion
+DoubleDouble ddFromString(const std::string& text)
+{
+    DoubleDouble value = { 0.0, 0.0 };
+    const DoubleDouble ten = { 10.0, 0.0 };
+    bool negative = false;
+    bool fraction = false;
+    int exponent = 0;
+    size_t i = 0;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+'))
+        negative = text[i++] == '-';
+    for (; i < text.size(); i++)
+    {
+        char ch = text[i];
+        if (ch == '.')
+            fraction = true;
+        else if (ch >= '0' && ch <= '9')
+        {
+            value = ddAdd(ddMul(value, ten), ddFromDouble(ch - '0'));
+            if (fraction)
+                exponent--;
+        }
+        else if (ch == 'e' || ch == 'E')
+        {
+            exponent += std::atoi(text.c_str() + i + 1);
+            break;
+        }
+    }
+    DoubleDouble power = { 1.0, 0.0 };
+    for (int e = 0; e < std::abs(exponent); e++)
+        power = ddMul(power, ten);
+    value = exponent < 0 ? ddDiv(value, power) : ddMul(value, power);
+    return negative ? DoubleDouble{ -value.hi, -value.lo } : value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fractal math
+///////////////////////////////////////////////////////////////////////////////
+static const double BAILOUT = 65536.0;  // squared escape radius, large for smooth coloring
+
+// iterates the view center in double-double precision and stores the orbit rounded to doubles
+void FractalBackground::ComputeReferenceOrbit(const FractalView& view, std::vector<glm::dvec2>& orbit)
+{
+    orbit.clear();
+    orbit.reserve(view.maxIterations + 1);
+    DoubleDouble zr, zi, cr, ci;
+    if (view.type == MANDELBROT)
+    {
+        zr = ddFromDouble(0.0);
+        zi = ddFromDouble(0.0);
+        cr = view.centerX;
+        ci = view.centerY;
+    }
+    else
+    {
+        zr = view.centerX;
+        zi = view.centerY;
+        cr = ddFromDouble(view.juliaC.x);
+        ci = ddFromDouble(view.juliaC.y);
+    }
+    for (int n = 0; n <= view.maxIterations; n++)
+    {
+        orbit.push_back(glm::dvec2(zr.hi, zi.hi));
+        if (zr.hi * zr.hi + zi.hi * zi.hi > BAILOUT)
+            break;
+        DoubleDouble zr2 = ddMul(zr, zr);
+        DoubleDouble zi2 = ddMul(zi, zi);
+        DoubleDouble zri = ddMul(zr, zi);
+        zr = ddAdd(ddSub(zr2, zi2), cr);
+        zi = ddAdd(ddAdd(zri, zri), ci);
+    }
+}
+
+static inline glm::dvec2 cmul(glm::dvec2 a, glm::dvec2 b)
+{
+    return glm::dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// computes the series coefficients A, B, C and returns how many iterations they let every pixel skip.
+// maxDelta is the largest pixel offset from the center, i.e. half the view diagonal.
+int FractalBackground::ComputeSeries(const FractalView& view, const std::vector<glm::dvec2>& orbit, double maxDelta, glm::dvec2 coefficients[3])
+{
+    // for Julia sets the delta starts as the pixel offset and no dc is added per step
+    glm::dvec2 A(view.type == JULIA ? 1.0 : 0.0, 0.0), B(0.0), C(0.0);
+    glm::dvec2 one(view.type == MANDELBROT ? 1.0 : 0.0, 0.0);
+    double d2 = maxDelta * maxDelta;
+    double d3 = d2 * maxDelta;
+    int skip = 0;
+    int last = (int)orbit.size() - 2;
+    while (skip < last)
+    {
+        glm::dvec2 Z2 = 2.0 * orbit[skip];
+        glm::dvec2 nA = cmul(Z2, A) + one;
+        glm::dvec2 nB = cmul(Z2, B) + cmul(A, A);
+        glm::dvec2 nC = cmul(Z2, C) + 2.0 * cmul(A, B);
+        // stop once the cubic term is no longer negligible next to the quadratic one
+        double lb = glm::length(nB) * d2;
+        double lc = glm::length(nC) * d3;
+        if (!std::isfinite(lc) || lc * 1000.0 > lb)
+            break;
+        A = nA;
+        B = nB;
+        C = nC;
+        skip++;
+    }
+    coefficients[0] = A;
+    coefficients[1] = B;
+    coefficients[2] = C;
+    return skip;
+}
+
+// returns the smooth iteration count of a pixel at offset delta from the center, or -1 inside the set
+float FractalBackground::IteratePixel(const FractalView& view, const std::vector<glm::dvec2>& orbit, int skip, const glm::dvec2 coefficients[3], glm::dvec2 delta)
+{
+    glm::dvec2 dc = view.type == MANDELBROT ? delta : glm::dvec2(0.0);
+    glm::dvec2 delta2 = cmul(delta, delta);
+    glm::dvec2 d = cmul(coefficients[0], delta) + cmul(coefficients[1], delta2) + cmul(coefficients[2], cmul(delta2, delta));
+    int m = skip;       // index into the reference orbit
+    int last = (int)orbit.size() - 1;
+    if (last < 1)
+        return 0.0f;
+    for (int n = skip; n < view.maxIterations; n++)
+    {
+        glm::dvec2 Z = orbit[m];
+        d = 2.0 * cmul(Z, d) + cmul(d, d) + dc;
+        m++;
+        glm::dvec2 z = orbit[m] + d;
+        double mag = z.x * z.x + z.y * z.y;
+        if (mag > BAILOUT)
+            return (float)(n + 1 - std::log2(std::log(mag) * 0.5 / std::log(2.0)));
+        // rebase once the pixel orbit gets closer to zero than to the reference, or the reference ran out
+        if (mag < d.x * d.x + d.y * d.y || m == last)
+        {
+            d = z - orbit[0];
+            m = 0;
+        }
+    }
+    return -1.0f;
+}
+
+void FractalBackground::RenderImage(const FractalView& view, double u0, double v0, double texel, int size, unsigned char* rgba)
+{
+    std::vector<glm::dvec2> orbit;
+    glm::dvec2 coefficients[3];
+    ComputeReferenceOrbit(view, orbit);
+    // the series has to hold for the whole view, the block may be anywhere in it
+    int skip = ComputeSeries(view, orbit, view.scale * 0.75, coefficients);
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            glm::dvec2 delta((u0 + (i + 0.5) * texel - 0.5) * view.scale, (v0 + (j + 0.5) * texel - 0.5) * view.scale);
+            float n = IteratePixel(view, orbit, skip, coefficients, delta);
+            unsigned char* pixel = rgba + ((size_t)j * size + i) * 4;
+            pixel[3] = 255;
+            if (n < 0.0f)
+            {
+                pixel[0] = pixel[1] = pixel[2] = 0;
+                continue;
+            }
+            // the cosine palette of fractal.fs
+            const double phase[3] = { 0.0, 0.33, 0.67 };
+            double t = n * 0.02;
+            for (int c = 0; c < 3; c++)
+                pixel[c] = (unsigned char)(255.0 * (0.5 + 0.5 * std::cos(6.28318 * (t + phase[c]))) + 0.5);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// background
+///////////////////////////////////////////////////////////////////////////////
+FractalBackground::FractalBackground(int width, int height) : width(width), height(height), shader("fractal.vs", "fractal.fs")
+{
+    pixels.assign((size_t)width * height, -1.0f);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // the fullscreen triangle is generated from gl_VertexID, core profile still wants a VAO bound
+    glGenVertexArrays(1, &VAO);
+
+    shader.use();
+    shader.setInt("iterations", 0);
+    SetCenter(centerRe, centerIm);
+    target = viewAt(0.0f);
+}
+
+FractalBackground::~FractalBackground()
+{
+    glDeleteTextures(1, &texture);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void FractalBackground::SetCenter(const std::string& re, const std::string& im)
+{
+    centerRe = re;
+    centerIm = im;
+    view.centerX = ddFromString(re);
+    view.centerY = ddFromString(im);
+    target = viewAt(time);
+}
+
+void FractalBackground::SetJulia(bool julia, glm::dvec2 c)
+{
+    view.type = julia ? JULIA : MANDELBROT;
+    view.juliaC = c;
+    target = viewAt(time);
+}
+
+FractalView FractalBackground::viewAt(float time) const
+{
+    FractalView v = view;
+    double t = Animate ? time : 0.0;
+    // loop the zoom once it runs out of precision
+    double period = std::log(StartScale / MinScale) / ZoomRate;
+    t = std::fmod(t, period);
+    v.scale = StartScale * std::exp(-ZoomRate * t);
+    // deeper views need more iterations to resolve the boundary
+    v.maxIterations = MaxIterations + (int)(50.0 * std::log2(StartScale / v.scale));
+    return v;
+}
+
+void FractalBackground::Update(float time)
+{
+    this->time = time;
+    // a render in progress keeps its view until it is fully refined, the display zooms into it meanwhile
+    if (!rendering)
+        target = viewAt(time);
+}
+
+uint64_t FractalBackground::Key()
+{
+    uint64_t hash = HashBytes(&target.type, sizeof(target.type));
+    hash = HashBytes(&target.centerX, sizeof(target.centerX), hash);
+    hash = HashBytes(&target.centerY, sizeof(target.centerY), hash);
+    hash = HashBytes(&target.juliaC, sizeof(target.juliaC), hash);
+    hash = HashBytes(&target.scale, sizeof(target.scale), hash);
+    return HashBytes(&target.maxIterations, sizeof(target.maxIterations), hash);
+}
+
+void FractalBackground::Restart()
+{
+    current = target;
+    ComputeReferenceOrbit(current, orbit);
+    double pixelSize = current.scale / height;
+    double maxDelta = 0.5 * pixelSize * std::sqrt((double)width * width + (double)height * height);
+    skip = ComputeSeries(current, orbit, maxDelta, coefficients);
+    // progressive refinement: 8x8 blocks first, each pass fills in the pixels the previous one skipped
+    passStep = 8;
+    nextTile = 0;
+    rendering = true;
+}
+
+bool FractalBackground::Step()
+{
+    int tilesX = (width + TILE - 1) / TILE;
+    int tilesY = (height + TILE - 1) / TILE;
+    int tileCount = tilesX * tilesY;
+
+    // one tile per thread keeps a step around a millisecond or two
+    ThreadPool& pool = ThreadPool::Shared();
+    int batch = std::min((int)pool.Size() + 1, tileCount - nextTile);
+    int firstTile = nextTile;
+    pool.ParallelFor(batch, [&](int i) { renderTile(firstTile + i, tilesX); });
+    nextTile += batch;
+
+    if (nextTile < tileCount)
+        return false;
+    // pass finished, show it
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    renderedScale = current.scale;
+    passStep /= 2;
+    nextTile = 0;
+    if (passStep > 0)
+        return false;
+    rendering = false;
+    return true;
+}
+
+void FractalBackground::Draw(float time)
+{
+    // the texture may lag behind the animation, zoom into it until the next render lands
+    double ratio = std::min(1.0, viewAt(time).scale / renderedScale);
+
+    shader.use();
+    shader.setFloat("zoom", (float)ratio);
+    shader.setFloat("time", time);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+}
+
+void FractalBackground::renderTile(int tile, int tilesX)
+{
+    const int step = passStep;
+    double pixelSize = current.scale / height;
+    int x0 = (tile % tilesX) * TILE;
+    int y0 = (tile / tilesX) * TILE;
+    int x1 = std::min(x0 + TILE, width);
+    int y1 = std::min(y0 + TILE, height);
+    for (int y = y0; y < y1; y += step)
+    {
+        for (int x = x0; x < x1; x += step)
+        {
+            // already computed by the coarser pass
+            if (step < 8 && x % (2 * step) == 0 && y % (2 * step) == 0)
+                continue;
+            glm::dvec2 delta((x + 0.5 - width * 0.5) * pixelSize, (y + 0.5 - height * 0.5) * pixelSize);
+            float value = IteratePixel(current, orbit, skip, coefficients, delta);
+            for (int by = y; by < std::min(y + step, y1); by++)
+                std::fill(pixels.begin() + (size_t)by * width + x, pixels.begin() + (size_t)by * width + std::min(x + step, x1), value);
+        }
+    }
+}
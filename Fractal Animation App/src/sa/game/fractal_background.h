@@ -0,0 +1,120 @@
+#ifndef FRACTAL_BACKGROUND_H
+#define FRACTAL_BACKGROUND_H
+///////////////////////////////////////////////////////////////////////////////
+// fractal_background.h
+// ====================
+// Animated deep-zoom Mandelbrot/Julia background that can replace the skybox.
+//
+// A single reference orbit is iterated on the CPU in double-double precision
+// (~32 significant digits) and every pixel only iterates its low-precision
+// difference (delta) from that orbit. A third order series approximation lets
+// all pixels skip the first iterations, and orbits that drift too far from the
+// reference are rebased onto it. Frames are rendered in tiles on the shared
+// thread pool, coarse to fine, a few tiles per RefineScheduler step, so the
+// background keeps animating while the next view is still being refined.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "refine_scheduler.h"
+
+// unevaluated sum of two doubles, used for the reference orbit and view center
+struct DoubleDouble
+{
+    double hi;
+    double lo;
+};
+
+DoubleDouble ddFromDouble(double value);
+DoubleDouble ddFromString(const std::string& text);
+DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddSub(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddMul(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddDiv(DoubleDouble a, DoubleDouble b);
+
+enum Fractal_Type {
+    MANDELBROT,
+    JULIA
+};
+
+// everything needed to render one still image of the fractal
+struct FractalView
+{
+    Fractal_Type type = MANDELBROT;
+    DoubleDouble centerX = { -0.75, 0.0 };
+    DoubleDouble centerY = { 0.0, 0.0 };
+    glm::dvec2 juliaC = glm::dvec2(-0.8, 0.156);
+    double scale = 3.0;             // height of the view in fractal units
+    int maxIterations = 1000;
+};
+
+class FractalBackground : public ProgressiveTask
+{
+public:
+    // animation options
+    float ZoomRate = 0.35f;         // e-folds of zoom per second
+    double MinScale = 1e-28;        // zoom stops here, double-double runs out of digits past ~1e-30
+    double StartScale = 3.0;
+    int MaxIterations = 1500;
+    bool Animate = true;
+
+    FractalBackground(int width, int height);
+    ~FractalBackground();
+
+    // center of the zoom, given as decimal strings so it keeps all of its digits
+    void SetCenter(const std::string& re, const std::string& im);
+    void SetJulia(bool julia, glm::dvec2 c = glm::dvec2(-0.8, 0.156));
+
+    // advances the animation, call once per frame before the scheduler runs
+    void Update(float time);
+    // ProgressiveTask, the key is the view being rendered and only moves on once it is fully refined
+    uint64_t Key() override;
+    void Restart() override;
+    bool Step() override;
+    // draws the background behind the scene, depth test must be enabled with GL_LEQUAL
+    void Draw(float time);
+
+    // rendering entry points, exposed so other schedulers can drive a render directly
+    static void ComputeReferenceOrbit(const FractalView& view, std::vector<glm::dvec2>& orbit);
+    static int ComputeSeries(const FractalView& view, const std::vector<glm::dvec2>& orbit, double maxDelta, glm::dvec2 coefficients[3]);
+    static float IteratePixel(const FractalView& view, const std::vector<glm::dvec2>& orbit, int skip, const glm::dvec2 coefficients[3], glm::dvec2 delta);
+    // colors a size x size RGBA8 block of the view with the background palette (at time 0). Pixel (i, j) sits at
+    // (u0 + (i + 0.5) * texel, v0 + (j + 0.5) * texel), where (0, 0)-(1, 1) spans the view. Used for virtual texture pages
+    static void RenderImage(const FractalView& view, double u0, double v0, double texel, int size, unsigned char* rgba);
+
+private:
+    int width, height;
+    Shader shader;
+    unsigned int texture = 0;
+    unsigned int VAO = 0;
+
+    static const int TILE = 16;
+
+    FractalView view;
+    std::string centerRe = "-0.743643887037158704752191506114774";
+    std::string centerIm = "0.131825904205311970493132056385139";
+    float time = 0.0f;
+
+    // render state, target is the view to render next, current the one being refined
+    FractalView target;
+    FractalView current;
+    bool rendering = false;
+    std::vector<glm::dvec2> orbit;
+    glm::dvec2 coefficients[3];
+    int skip = 0;
+    int passStep = 8;               // pixel block size of the current pass
+    int nextTile = 0;
+    std::vector<float> pixels;
+    double renderedScale = 3.0;     // scale of the image currently in the texture
+
+    FractalView viewAt(float time) const;
+    void renderTile(int tile, int tilesX);
+};
+
+#endif
@@ -0,0 +1,255 @@
+// Parallel iso-surface extraction of fractal distance fields, see fractal_mesher.h
+
+#include "fractal_mesher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "thread_pool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// distance estimates
+///////////////////////////////////////////////////////////////////////////////
+float MandelbulbDistance(glm::vec3 p, float power, int iterations)
+{
+    glm::vec3 z = p;
+    float dr = 1.0f;
+    float r = 0.0f;
+    for (int i = 0; i < iterations; i++)
+    {
+        r = glm::length(z);
+        if (r > 2.0f)
+            break;
+        // convert to polar coordinates, raise to the power and rotate
+        float theta = std::acos(glm::clamp(z.z / std::max(r, 1e-12f), -1.0f, 1.0f)) * power;
+        float phi = std::atan2(z.y, z.x) * power;
+        dr = std::pow(r, power - 1.0f) * power * dr + 1.0f;
+        float zr = std::pow(r, power);
+        z = zr * glm::vec3(std::sin(theta) * std::cos(phi), std::sin(phi) * std::sin(theta), std::cos(theta)) + p;
+    }
+    r = std::max(r, 1e-12f);
+    return 0.5f * std::log(r) * r / dr;
+}
+
+float QuaternionJuliaDistance(glm::vec3 p, glm::vec4 c, int iterations)
+{
+    glm::vec4 q(p, 0.0f);
+    glm::vec4 dq(1.0f, 0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < iterations; i++)
+    {
+        // dq' = 2 q dq, q' = q^2 + c
+        dq = 2.0f * glm::vec4(q.x * dq.x - glm::dot(glm::vec3(q.y, q.z, q.w), glm::vec3(dq.y, dq.z, dq.w)),
+                              glm::vec3(q.x * glm::vec3(dq.y, dq.z, dq.w) + dq.x * glm::vec3(q.y, q.z, q.w)
+                                        + glm::cross(glm::vec3(q.y, q.z, q.w), glm::vec3(dq.y, dq.z, dq.w))));
+        q = glm::vec4(q.x * q.x - q.y * q.y - q.z * q.z - q.w * q.w, 2.0f * q.x * q.y, 2.0f * q.x * q.z, 2.0f * q.x * q.w) + c;
+        if (glm::dot(q, q) > 16.0f)
+            break;
+    }
+    float r = std::max(glm::length(q), 1e-12f);
+    return 0.5f * r * std::log(r) / std::max(glm::length(dq), 1e-12f);
+}
+
+uint64_t HashFractalFieldParams(const FractalFieldParams& params)
+{
+    // hash field by field, the struct has padding
+    uint64_t hash = HashValue(params.field);
+    hash = HashValue(params.resolution, hash);
+    hash = HashValue(params.iterations, hash);
+    hash = HashValue(params.power, hash);
+    hash = HashValue(params.juliaC, hash);
+    hash = HashValue(params.iso, hash);
+    hash = HashValue(params.boundsMin, hash);
+    hash = HashValue(params.boundsMax, hash);
+    return hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// extraction
+///////////////////////////////////////////////////////////////////////////////
+namespace
+{
+    // cube corners and the six tetrahedra sharing the 0-6 diagonal. Every cell uses the same split,
+    // so neighbouring cells agree on the face diagonals and the surface has no cracks.
+    const glm::ivec3 CORNERS[8] = {
+        glm::ivec3(0, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(1, 1, 0), glm::ivec3(0, 1, 0),
+        glm::ivec3(0, 0, 1), glm::ivec3(1, 0, 1), glm::ivec3(1, 1, 1), glm::ivec3(0, 1, 1)
+    };
+    const int TETRAHEDRA[6][4] = {
+        { 0, 6, 1, 2 }, { 0, 6, 2, 3 }, { 0, 6, 3, 7 }, { 0, 6, 7, 4 }, { 0, 6, 4, 5 }, { 0, 6, 5, 1 }
+    };
+
+    struct Chunk {
+        vector<Vertex>       vertices;
+        vector<uint64_t>     keys;      // lattice edge of every vertex
+        vector<char>         shared;    // edge lies on a chunk boundary plane
+        vector<unsigned int> indices;
+    };
+}
+
+MeshData ExtractFractalMesh(const FractalFieldParams& params)
+{
+    const int N = std::max(params.resolution, 1);
+    const int S = N + 1;    // lattice points per axis
+    const glm::vec3 cellSize = (params.boundsMax - params.boundsMin) / (float)N;
+    ThreadPool& pool = ThreadPool::Shared();
+    const int threads = (int)pool.Size() + 1;
+
+    auto latticeIndex = [S](glm::ivec3 p) { return (uint32_t)(p.x + S * (p.y + S * p.z)); };
+    auto latticePosition = [&](glm::ivec3 p) { return params.boundsMin + glm::vec3(p) * cellSize; };
+
+    // 1. sample the field, one z-slice per task
+    vector<float> field((size_t)S * S * S);
+    pool.ParallelFor(S, [&](int z)
+    {
+        for (int y = 0; y < S; y++)
+            for (int x = 0; x < S; x++)
+            {
+                glm::vec3 p = latticePosition(glm::ivec3(x, y, z));
+                float d = params.field == MANDELBULB ? MandelbulbDistance(p, params.power, params.iterations)
+                                                     : QuaternionJuliaDistance(p, params.juliaC, params.iterations);
+                field[latticeIndex(glm::ivec3(x, y, z))] = d - params.iso;
+            }
+    });
+
+    auto sample = [&](glm::ivec3 p)
+    {
+        return field[latticeIndex(glm::clamp(p, glm::ivec3(0), glm::ivec3(N)))];
+    };
+    // central difference gradient, points out of the surface
+    auto gradient = [&](glm::ivec3 p)
+    {
+        return glm::vec3(sample(p + glm::ivec3(1, 0, 0)) - sample(p - glm::ivec3(1, 0, 0)),
+                         sample(p + glm::ivec3(0, 1, 0)) - sample(p - glm::ivec3(0, 1, 0)),
+                         sample(p + glm::ivec3(0, 0, 1)) - sample(p - glm::ivec3(0, 0, 1)));
+    };
+
+    // 2. polygonize z-slabs of cells, each with its own edge table
+    const int chunkCount = std::min(N, threads * 4);
+    vector<Chunk> chunks(chunkCount);
+    pool.ParallelFor(chunkCount, [&](int c)
+    {
+        Chunk& chunk = chunks[c];
+        int z0 = N * c / chunkCount;
+        int z1 = N * (c + 1) / chunkCount;
+        std::unordered_map<uint64_t, unsigned int> edges;
+
+        auto edgeVertex = [&](glm::ivec3 a, glm::ivec3 b) -> unsigned int
+        {
+            uint32_t ia = latticeIndex(a), ib = latticeIndex(b);
+            if (ia > ib)
+            {
+                std::swap(ia, ib);
+                std::swap(a, b);
+            }
+            uint64_t key = ((uint64_t)ia << 32) | ib;
+            auto found = edges.find(key);
+            if (found != edges.end())
+                return found->second;
+
+            float fa = field[ia], fb = field[ib];
+            float t = fa != fb ? fa / (fa - fb) : 0.5f;
+            Vertex vertex{};
+            vertex.Position = glm::mix(latticePosition(a), latticePosition(b), t);
+            glm::vec3 n = glm::mix(gradient(a), gradient(b), t);
+            vertex.Normal = glm::length(n) > 0.0f ? glm::normalize(n) : glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoords = glm::vec2((vertex.Position - params.boundsMin) / (params.boundsMax - params.boundsMin));
+
+            unsigned int index = (unsigned int)chunk.vertices.size();
+            chunk.vertices.push_back(vertex);
+            chunk.keys.push_back(key);
+            chunk.shared.push_back((a.z == z0 && b.z == z0) || (a.z == z1 && b.z == z1));
+            edges.emplace(key, index);
+            return index;
+        };
+
+        auto triangle = [&](unsigned int i0, unsigned int i1, unsigned int i2)
+        {
+            if (i0 == i1 || i1 == i2 || i0 == i2)
+                return;
+            const Vertex& v0 = chunk.vertices[i0];
+            const Vertex& v1 = chunk.vertices[i1];
+            const Vertex& v2 = chunk.vertices[i2];
+            // wind counter-clockwise when seen from outside
+            glm::vec3 faceNormal = glm::cross(v1.Position - v0.Position, v2.Position - v0.Position);
+            if (glm::dot(faceNormal, v0.Normal + v1.Normal + v2.Normal) < 0.0f)
+                std::swap(i1, i2);
+            chunk.indices.push_back(i0);
+            chunk.indices.push_back(i1);
+            chunk.indices.push_back(i2);
+        };
+
+        for (int z = z0; z < z1; z++)
+            for (int y = 0; y < N; y++)
+                for (int x = 0; x < N; x++)
+                {
+                    glm::ivec3 cell(x, y, z);
+                    for (const int* tet : TETRAHEDRA)
+                    {
+                        glm::ivec3 in[4], out[4];
+                        int inCount = 0, outCount = 0;
+                        for (int k = 0; k < 4; k++)
+                        {
+                            glm::ivec3 p = cell + CORNERS[tet[k]];
+                            if (field[latticeIndex(p)] < 0.0f)
+                                in[inCount++] = p;
+                            else
+                                out[outCount++] = p;
+                        }
+                        if (inCount == 1)
+                            triangle(edgeVertex(in[0], out[0]), edgeVertex(in[0], out[1]), edgeVertex(in[0], out[2]));
+                        else if (inCount == 3)
+                            triangle(edgeVertex(out[0], in[0]), edgeVertex(out[0], in[1]), edgeVertex(out[0], in[2]));
+                        else if (inCount == 2)
+                        {
+                            unsigned int q0 = edgeVertex(in[0], out[0]);
+                            unsigned int q1 = edgeVertex(in[0], out[1]);
+                            unsigned int q2 = edgeVertex(in[1], out[1]);
+                            unsigned int q3 = edgeVertex(in[1], out[0]);
+                            triangle(q0, q1, q2);
+                            triangle(q0, q2, q3);
+                        }
+                    }
+                }
+    });
+
+    // 3. merge in chunk order, only vertices on the slab boundaries can be shared between chunks
+    MeshData mesh;
+    std::unordered_map<uint64_t, unsigned int> boundary;
+    for (const Chunk& chunk : chunks)
+    {
+        vector<unsigned int> remap(chunk.vertices.size());
+        for (size_t i = 0; i < chunk.vertices.size(); i++)
+        {
+            if (chunk.shared[i])
+            {
+                auto found = boundary.find(chunk.keys[i]);
+                if (found != boundary.end())
+                {
+                    remap[i] = found->second;
+                    continue;
+                }
+                boundary.emplace(chunk.keys[i], (unsigned int)mesh.vertices.size());
+            }
+            remap[i] = (unsigned int)mesh.vertices.size();
+            mesh.vertices.push_back(chunk.vertices[i]);
+        }
+        for (unsigned int index : chunk.indices)
+            mesh.indices.push_back(remap[index]);
+    }
+    mesh.attributes = VERTEX_POSITION | VERTEX_NORMAL | VERTEX_TEXCOORDS;
+    return mesh;
+}
+
+MeshData LoadOrExtractFractalMesh(const std::string& cachePath, const FractalFieldParams& params, const LodSettings& lods)
+{
+    uint64_t key = HashLodSettings(lods, HashFractalFieldParams(params));
+    vector<MeshData> meshes;
+    if (LoadMeshFile(cachePath, key, meshes) && meshes.size() == 1)
+        return meshes[0];
+
+    meshes.assign(1, ExtractFractalMesh(params));
+    BuildLods(meshes[0], lods);
+    SaveMeshFile(cachePath, key, meshes);
+    return meshes[0];
+}
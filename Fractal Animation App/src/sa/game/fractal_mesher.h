@@ -0,0 +1,55 @@
+#ifndef FRACTAL_MESHER_H
+#define FRACTAL_MESHER_H
+///////////////////////////////////////////////////////////////////////////////
+// fractal_mesher.h
+// ================
+// Extracts the surface of a 3D fractal distance field (Mandelbulb or
+// quaternion Julia set) as an indexed triangle mesh for Mesh.
+//
+// The field is sampled on a lattice and polygonized cell by cell. Each cell is
+// split into six tetrahedra around its main diagonal, which gives a watertight
+// surface without the 256 case lookup tables of classic marching cubes. Both
+// sampling and polygonization run in parallel over z-slab chunks; every chunk
+// welds its vertices through its own edge hash table, and chunks are merged in
+// order so the output is identical no matter how many threads ran.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+
+enum Fractal_Field {
+    MANDELBULB,
+    QUATERNION_JULIA
+};
+
+struct FractalFieldParams
+{
+    Fractal_Field field = MANDELBULB;
+    int resolution = 96;            // cells along each axis
+    int iterations = 8;
+    float power = 8.0f;             // Mandelbulb exponent
+    glm::vec4 juliaC = glm::vec4(-0.2f, 0.6f, 0.2f, 0.2f);
+    float iso = 0.002f;             // surface sits at this distance estimate
+    glm::vec3 boundsMin = glm::vec3(-1.2f);
+    glm::vec3 boundsMax = glm::vec3(1.2f);
+};
+
+// distance estimates, positive outside the set
+float MandelbulbDistance(glm::vec3 p, float power, int iterations);
+float QuaternionJuliaDistance(glm::vec3 p, glm::vec4 c, int iterations);
+
+// identifies the mesh a set of parameters produces, used as the cache key
+uint64_t HashFractalFieldParams(const FractalFieldParams& params);
+
+// samples the field and extracts the iso-surface
+MeshData ExtractFractalMesh(const FractalFieldParams& params);
+
+// loads the mesh from cachePath if it was extracted with the same parameters, otherwise extracts it, builds its
+// levels of detail and saves it
+MeshData LoadOrExtractFractalMesh(const std::string& cachePath, const FractalFieldParams& params, const LodSettings& lods = LodSettings());
+
+#endif
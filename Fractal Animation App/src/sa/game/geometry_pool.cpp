@@ -0,0 +1,219 @@
+// Shared vertex and index buffers with indirect submission, see geometry_pool.h
+
+#include "geometry_pool.h"
+
+#include <algorithm>
+
+namespace
+{
+    // the first buffers of a layout, they double from there
+    const size_t MIN_VERTICES = 1 << 16;
+    const size_t MIN_INDICES = 1 << 18;
+
+    // a new buffer of bytes with the first used bytes of old copied over, old is deleted
+    unsigned int Regrow(unsigned int old, size_t used, size_t bytes)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        if (old)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, old);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &old);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+}
+
+GeometryPool::~GeometryPool()
+{
+    for (Block& block : blocks)
+    {
+        glDeleteVertexArrays(1, &block.VAO);
+        glDeleteBuffers(1, &block.VBO);
+        glDeleteBuffers(1, &block.EBO);
+        if (block.commandBuffer)
+        {
+            glDeleteBuffers(1, &block.commandBuffer);
+            glDeleteBuffers(1, &block.drawBuffer);
+        }
+    }
+}
+
+GeometryPool::Block& GeometryPool::block(unsigned int attributes)
+{
+    VertexLayout layout(attributes);
+    for (Block& block : blocks)
+        if (block.layout.Attributes == layout.Attributes)
+            return block;
+
+    blocks.push_back(Block(attributes));
+    Block& block = blocks.back();
+    glGenVertexArrays(1, &block.VAO);
+    if (MultiDraw())
+    {
+        // the per draw values are instanced attributes, each command's base instance selects its entry. the arrays
+        // are only enabled inside Submit, direct draws of a pooled mesh read the current values Mesh::Bind sets
+        glGenBuffers(1, &block.commandBuffer);
+        glGenBuffers(1, &block.drawBuffer);
+        glBindVertexArray(block.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, block.drawBuffer);
+        // the whole layer-less rect until the first Submit, so the buffer never has an unspecified store
+        DrawData unpacked = { glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), -1.0f };
+        glBufferData(GL_ARRAY_BUFFER, sizeof(DrawData), &unpacked, GL_STREAM_DRAW);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (void*)offsetof(DrawData, rect));
+        glVertexAttribDivisor(7, 1);
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(DrawData), (void*)offsetof(DrawData, layer));
+        glVertexAttribDivisor(8, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+    return block;
+}
+
+GeometryPool::Block* GeometryPool::find(unsigned int VAO)
+{
+    for (Block& block : blocks)
+        if (block.VAO == VAO)
+            return &block;
+    return nullptr;
+}
+
+void GeometryPool::reserve(Block& block, size_t vertices, size_t indices)
+{
+    bool moved = false;
+    if (block.vertices + vertices > block.vertexCapacity)
+    {
+        size_t capacity = std::max(std::max(MIN_VERTICES, block.vertexCapacity * 2), block.vertices + vertices);
+        block.VBO = Regrow(block.VBO, block.vertices * block.layout.Stride, capacity * block.layout.Stride);
+        block.vertexCapacity = capacity;
+        moved = true;
+    }
+    if (block.indices + indices > block.indexCapacity)
+    {
+        size_t capacity = std::max(std::max(MIN_INDICES, block.indexCapacity * 2), block.indices + indices);
+        block.EBO = Regrow(block.EBO, block.indices * sizeof(unsigned int), capacity * sizeof(unsigned int));
+        block.indexCapacity = capacity;
+        moved = true;
+    }
+    if (!moved)
+        return;
+    // the vertex array still points at the old buffers
+    glBindVertexArray(block.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+    block.layout.Apply();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.EBO);
+    glBindVertexArray(0);
+}
+
+GeometryRange GeometryPool::Add(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int attributes)
+{
+    Block& block = this->block(attributes);
+    reserve(block, vertices.size(), indices.size());
+
+    std::vector<unsigned char> packed = block.layout.Pack(vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, block.vertices * block.layout.Stride, packed.size(), packed.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, block.indices * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    GeometryRange range;
+    range.VAO = block.VAO;
+    range.FirstIndex = (GLuint)block.indices;
+    range.IndexCount = (GLsizei)indices.size();
+    range.BaseVertex = (GLint)block.vertices;
+    range.VertexCount = (GLsizei)vertices.size();
+    block.vertices += vertices.size();
+    block.indices += indices.size();
+    return range;
+}
+
+void GeometryPool::Draw(const GeometryRange& range)
+{
+    glBindVertexArray(range.VAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.IndexCount, GL_UNSIGNED_INT,
+                             (void*)(range.FirstIndex * sizeof(unsigned int)), range.BaseVertex);
+    glBindVertexArray(0);
+}
+
+void GeometryPool::Queue(const GeometryRange& range, glm::vec4 atlasRect, int atlasLayer)
+{
+    Block* block = find(range.VAO);
+    if (!block || range.IndexCount == 0)
+        return;
+    Command command;
+    command.count = (GLuint)range.IndexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.FirstIndex;
+    command.baseVertex = range.BaseVertex;
+    command.baseInstance = (GLuint)block->commands.size();
+    block->commands.push_back(command);
+    block->draws.push_back({ atlasRect, (float)atlasLayer });
+}
+
+void GeometryPool::Submit()
+{
+    drawCalls = 0;
+    for (Block& block : blocks)
+    {
+        if (block.commands.empty())
+            continue;
+        glBindVertexArray(block.VAO);
+        if (block.commandBuffer)
+        {
+            // both arrays are rebuilt every frame, orphaning keeps the driver from waiting on last frame's draws
+            glBindBuffer(GL_ARRAY_BUFFER, block.drawBuffer);
+            glBufferData(GL_ARRAY_BUFFER, block.draws.size() * sizeof(DrawData), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, block.draws.size() * sizeof(DrawData), block.draws.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, block.commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, block.commands.size() * sizeof(Command), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, block.commands.size() * sizeof(Command), block.commands.data());
+            glEnableVertexAttribArray(7);
+            glEnableVertexAttribArray(8);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)block.commands.size(), 0);
+            glDisableVertexAttribArray(7);
+            glDisableVertexAttribArray(8);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            drawCalls++;
+        }
+        else
+        {
+            for (size_t i = 0; i < block.commands.size(); i++)
+            {
+                const Command& command = block.commands[i];
+                // no array behind attributes 7 and 8 here, the current value is the same for every vertex
+                glVertexAttrib4fv(7, &block.draws[i].rect[0]);
+                glVertexAttrib1f(8, block.draws[i].layer);
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)command.count, GL_UNSIGNED_INT,
+                                         (void*)(command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+                drawCalls++;
+            }
+        }
+        block.commands.clear();
+        block.draws.clear();
+    }
+    glBindVertexArray(0);
+}
+
+size_t GeometryPool::VertexBytes() const
+{
+    size_t bytes = 0;
+    for (const Block& block : blocks)
+        bytes += block.vertices * block.layout.Stride;
+    return bytes;
+}
+
+size_t GeometryPool::IndexBytes() const
+{
+    size_t bytes = 0;
+    for (const Block& block : blocks)
+        bytes += block.indices * sizeof(unsigned int);
+    return bytes;
+}
@@ -0,0 +1,95 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+///////////////////////////////////////////////////////////////////////////////
+// geometry_pool.h
+// ===============
+// Large vertex and index buffers shared by every mesh with the same vertex
+// layout. Add packs a mesh into the buffers of its layout and returns where
+// it landed; each layout has one vertex array, so a model (or a whole scene)
+// is drawn with one bind and glDrawElementsBaseVertex per mesh. Buffers that
+// fill up are replaced by bigger ones on the GPU with glCopyBufferSubData,
+// ranges handed out before stay valid.
+//
+// Queue and Submit go further: the queued ranges of a layout become one
+// command buffer per frame and a single glMultiDrawElementsIndirect. Every
+// command carries its draw index as base instance, which picks the atlas
+// rect and layer (attributes 7 and 8, see batched.vs) from a per draw array,
+// so meshes with different textures in one texture array can share a call.
+// The per draw arrays are only enabled during Submit, a pooled mesh drawn
+// directly gets its atlas values from Mesh::Bind like any other mesh.
+// Multi draw indirect needs GL 4.3 or ARB_multi_draw_indirect on the 3.3
+// context (see gl_features.h); without it every range gets its own base
+// vertex call and the atlas values as current attribute values.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "gl_features.h"
+#include "mesh.h"
+
+class GeometryPool
+{
+public:
+    GeometryPool() {}
+    ~GeometryPool();
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    // copies the attributes of a mesh's vertices and its indices into the shared buffers of its layout
+    GeometryRange Add(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int attributes);
+
+    // draws a range with the shader and textures already bound, binds its vertex array
+    void Draw(const GeometryRange& range);
+
+    // adds a range to this frame's draws, the atlas rect and layer are what attributes 7 and 8 read for it
+    void Queue(const GeometryRange& range, glm::vec4 atlasRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), int atlasLayer = -1);
+    // draws everything queued with the bound shader, one multi draw per layout, and empties the queue
+    void Submit();
+
+    bool MultiDraw() const { return glFeatures.MultiDrawIndirect; }
+    size_t VertexBytes() const;
+    size_t IndexBytes() const;
+    int DrawCalls() const { return drawCalls; }
+
+private:
+    // the layout of glMultiDrawElementsIndirect's commands
+    struct Command
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint  baseVertex;
+        GLuint baseInstance;
+    };
+    // read by attributes 7 and 8 with a divisor of 1
+    struct DrawData
+    {
+        glm::vec4 rect;
+        float layer;
+    };
+    struct Block
+    {
+        VertexLayout layout;
+        unsigned int VAO = 0, VBO = 0, EBO = 0;
+        size_t vertices = 0, vertexCapacity = 0;    // in vertices
+        size_t indices = 0, indexCapacity = 0;      // in indices
+        std::vector<Command> commands;
+        std::vector<DrawData> draws;
+        unsigned int commandBuffer = 0, drawBuffer = 0;
+
+        explicit Block(unsigned int attributes) : layout(attributes) {}
+    };
+
+    Block& block(unsigned int attributes);
+    Block* find(unsigned int VAO);
+    // makes room for more vertices and indices, copying what the block already has
+    void reserve(Block& block, size_t vertices, size_t indices);
+
+    std::vector<Block> blocks;  // one per layout, a handful at most
+    int drawCalls = 0;          // GL draw calls of the last Submit
+};
+
+#endif
@@ -0,0 +1,23 @@
+// Entry points of optional GL features, see gl_features.h
+
+#include "gl_features.h"
+
+GLFeatures glFeatures;
+
+void LoadGLFeatures(GLADloadproc load, int (*extensionSupported)(const char*))
+{
+    // a 4.4 context already has it from glad
+    if (!GLAD_GL_VERSION_4_4 && extensionSupported("GL_ARB_buffer_storage"))
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    glFeatures.BufferStorage = glBufferStorage != nullptr;
+
+    // the pool's indirect draws also read the indirect buffer and pick their per draw values by base instance
+    if (!GLAD_GL_VERSION_4_3 && extensionSupported("GL_ARB_multi_draw_indirect") &&
+        extensionSupported("GL_ARB_draw_indirect") && extensionSupported("GL_ARB_base_instance"))
+        glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+    glFeatures.MultiDrawIndirect = glMultiDrawElementsIndirect != nullptr;
+
+    if (!GLAD_GL_VERSION_4_4 && extensionSupported("GL_ARB_multi_bind"))
+        glad_glBindTextures = (PFNGLBINDTEXTURESPROC)load("glBindTextures");
+    glFeatures.MultiBind = glBindTextures != nullptr;
+}
@@ -0,0 +1,27 @@
+#ifndef GL_FEATURES_H
+#define GL_FEATURES_H
+///////////////////////////////////////////////////////////////////////////////
+// gl_features.h
+// =============
+// Optional GL features above the 3.3 core context the app asks for. glad was
+// generated for GL 4.5 without extensions, so it only loads a newer entry
+// point when the driver hands out a context of that version. LoadGLFeatures
+// also loads them from the matching ARB extension of an older context and
+// records what is there, the code using a feature checks glFeatures.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+
+struct GLFeatures
+{
+    bool BufferStorage = false;     // glBufferStorage, GL 4.4 or ARB_buffer_storage
+    bool MultiDrawIndirect = false; // glMultiDrawElementsIndirect with base instances, GL 4.3 or the three ARB extensions behind it
+    bool MultiBind = false;         // glBindTextures, GL 4.4 or ARB_multi_bind
+};
+
+extern GLFeatures glFeatures;
+
+// call once after gladLoadGLLoader with the same loader, extensionSupported is glfwExtensionSupported
+void LoadGLFeatures(GLADloadproc load, int (*extensionSupported)(const char*));
+
+#endif
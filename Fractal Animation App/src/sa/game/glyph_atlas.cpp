@@ -0,0 +1,608 @@
+// One texture for all glyphs of a font, see glyph_atlas.h
+
+#include "glyph_atlas.h"
+#include "thread_pool.h"
+#include "hash.h"
+
+#include <glad/glad.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    const int PADDING = 1;
+
+    struct Bitmap {
+        int code;
+        int width, height;
+        std::vector<unsigned char> pixels;
+    };
+
+    // a glyph outline flattened to line segments, in field pixels with y up
+    struct Shape {
+        int code;
+        int width, height;
+        glm::ivec2 origin;              // field pixel position of the bitmap's top left corner
+        std::vector<glm::vec4> edges;   // a.xy, b.xy
+    };
+
+    struct Flattener {
+        Shape* shape;
+        float scale;
+        glm::vec2 pen;
+
+        glm::vec2 Point(const FT_Vector* v) const { return glm::vec2(v->x, v->y) * scale; }
+        void Line(glm::vec2 to)
+        {
+            if (to != pen)
+                shape->edges.push_back(glm::vec4(pen, to));
+            pen = to;
+        }
+    };
+
+    int MoveTo(const FT_Vector* to, void* user)
+    {
+        Flattener* f = (Flattener*)user;
+        f->pen = f->Point(to);
+        return 0;
+    }
+
+    int LineTo(const FT_Vector* to, void* user)
+    {
+        Flattener* f = (Flattener*)user;
+        f->Line(f->Point(to));
+        return 0;
+    }
+
+    int ConicTo(const FT_Vector* control, const FT_Vector* to, void* user)
+    {
+        Flattener* f = (Flattener*)user;
+        glm::vec2 p0 = f->pen, p1 = f->Point(control), p2 = f->Point(to);
+        const int steps = 8;
+        for (int i = 1; i <= steps; i++)
+        {
+            float t = (float)i / steps, s = 1.0f - t;
+            f->Line(s * s * p0 + 2.0f * s * t * p1 + t * t * p2);
+        }
+        return 0;
+    }
+
+    int CubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
+    {
+        Flattener* f = (Flattener*)user;
+        glm::vec2 p0 = f->pen, p1 = f->Point(control1), p2 = f->Point(control2), p3 = f->Point(to);
+        const int steps = 12;
+        for (int i = 1; i <= steps; i++)
+        {
+            float t = (float)i / steps, s = 1.0f - t;
+            f->Line(s * s * s * p0 + 3.0f * s * s * t * p1 + 3.0f * s * t * t * p2 + t * t * t * p3);
+        }
+        return 0;
+    }
+
+    // brute force nearest edge per pixel, inside is decided by the non-zero winding rule
+    Bitmap ComputeField(const Shape& shape, int spread)
+    {
+        Bitmap bitmap;
+        bitmap.code = shape.code;
+        bitmap.width = shape.width;
+        bitmap.height = shape.height;
+        bitmap.pixels.resize((size_t)shape.width * shape.height);
+        for (int row = 0; row < shape.height; row++)
+            for (int col = 0; col < shape.width; col++)
+            {
+                glm::vec2 p(shape.origin.x + col + 0.5f, shape.origin.y - row - 0.5f);
+                float nearest = 1e30f;
+                int winding = 0;
+                for (const glm::vec4& edge : shape.edges)
+                {
+                    glm::vec2 a(edge.x, edge.y), ab = glm::vec2(edge.z, edge.w) - a, ap = p - a;
+                    float t = glm::clamp(glm::dot(ap, ab) / glm::dot(ab, ab), 0.0f, 1.0f);
+                    glm::vec2 d = ap - ab * t;
+                    nearest = std::min(nearest, glm::dot(d, d));
+                    // edges crossing a ray from p towards +x
+                    if ((a.y <= p.y) != (edge.w <= p.y))
+                    {
+                        float side = ab.x * ap.y - ab.y * ap.x;
+                        if (ab.y > 0.0f && side > 0.0f)
+                            winding++;
+                        else if (ab.y < 0.0f && side < 0.0f)
+                            winding--;
+                    }
+                }
+                float distance = std::sqrt(nearest) * (winding != 0 ? 1.0f : -1.0f);
+                float value = glm::clamp(0.5f + distance / (2.0f * spread), 0.0f, 1.0f);
+                bitmap.pixels[(size_t)row * shape.width + col] = (unsigned char)(value * 255.0f + 0.5f);
+            }
+        return bitmap;
+    }
+
+    // the unscaled outline of code flattened into shape, with glyph's metrics in pixelSize units
+    bool LoadOutline(FT_Face face, unsigned int code, int fieldSize, int pixelSize, int spread, Shape& shape, Glyph& glyph)
+    {
+        if (FT_Load_Char(face, code, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP))
+            return false;
+        float toField = (float)fieldSize / face->units_per_EM;
+        float toPixels = (float)pixelSize / fieldSize;
+        FT_GlyphSlot slot = face->glyph;
+        glyph = Glyph();
+        glyph.Advance = slot->advance.x * toField * toPixels;
+        shape.code = code;
+        shape.edges.clear();
+        if (slot->format != FT_GLYPH_FORMAT_OUTLINE || slot->outline.n_points == 0)
+            return true;
+
+        FT_BBox box;
+        FT_Outline_Get_CBox(&slot->outline, &box);
+        int x0 = (int)std::floor(box.xMin * toField) - spread, x1 = (int)std::ceil(box.xMax * toField) + spread;
+        int y0 = (int)std::floor(box.yMin * toField) - spread, y1 = (int)std::ceil(box.yMax * toField) + spread;
+        shape.width = x1 - x0;
+        shape.height = y1 - y0;
+        shape.origin = glm::ivec2(x0, y1);
+        FT_Outline_Funcs funcs = { MoveTo, LineTo, ConicTo, CubicTo, 0, 0 };
+        Flattener flattener = { &shape, toField, glm::vec2(0.0f) };
+        FT_Outline_Decompose(&slot->outline, &funcs, &flattener);
+        if (!shape.edges.empty())
+        {
+            glyph.Size = glm::vec2(shape.width, shape.height) * toPixels;
+            glyph.Bearing = glm::vec2(x0, y1) * toPixels;
+        }
+        return true;
+    }
+
+    // the coverage bitmap of code at the face's pixel size
+    bool LoadBitmap(FT_Face face, unsigned int code, Bitmap& bitmap, Glyph& glyph)
+    {
+        if (FT_Load_Char(face, code, FT_LOAD_RENDER))
+            return false;
+        FT_GlyphSlot slot = face->glyph;
+        glyph = Glyph();
+        glyph.Size = glm::vec2(slot->bitmap.width, slot->bitmap.rows);
+        glyph.Bearing = glm::vec2(slot->bitmap_left, slot->bitmap_top);
+        glyph.Advance = slot->advance.x / 64.0f;
+
+        bitmap.code = code;
+        bitmap.width = slot->bitmap.width;
+        bitmap.height = slot->bitmap.rows;
+        bitmap.pixels.resize((size_t)bitmap.width * bitmap.height);
+        for (int row = 0; row < bitmap.height; row++)
+            std::copy_n(slot->bitmap.buffer + row * slot->bitmap.pitch, bitmap.width, bitmap.pixels.begin() + (size_t)row * bitmap.width);
+        return true;
+    }
+
+    // baked atlas format
+    // --------------------
+    // header, the 128 ASCII glyphs, per extended glyph its code point and Glyph, then the
+    // width x height atlas. key covers the font file and the generation parameters, a file
+    // with another key or version is treated as missing.
+    const char ATLAS_FILE_MAGIC[4] = { 'S', 'A', 'F', 'A' };
+    const uint32_t ATLAS_FILE_VERSION = 1;
+
+    struct AtlasFileHeader {
+        char     magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t glyphSize;     // sizeof(Glyph) when written, guards against layout changes
+        uint32_t extendedCount;
+        int32_t  width, height;
+        int32_t  penX, penY, shelf;
+    };
+
+    bool TallerFirst(const Bitmap& a, const Bitmap& b)
+    {
+        return a.height > b.height;
+    }
+}
+
+unsigned int DecodeUTF8(const std::string& text, size_t& i)
+{
+    const unsigned int REPLACEMENT = 0xFFFD;
+    unsigned char lead = (unsigned char)text[i++];
+    if (lead < 0x80)
+        return lead;
+    int extra;
+    unsigned int code;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        extra = 1;
+        code = lead & 0x1F;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        extra = 2;
+        code = lead & 0x0F;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        extra = 3;
+        code = lead & 0x07;
+    }
+    else
+        return REPLACEMENT;     // stray continuation byte
+    for (int k = 0; k < extra; k++)
+    {
+        if (i >= text.size() || ((unsigned char)text[i] & 0xC0) != 0x80)
+            return REPLACEMENT;
+        code = (code << 6) | ((unsigned char)text[i++] & 0x3F);
+    }
+    // overlong forms, surrogates and anything past the last code point
+    static const unsigned int smallest[4] = { 0, 0x80, 0x800, 0x10000 };
+    if (code < smallest[extra] || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF)
+        return REPLACEMENT;
+    return code;
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    Close();
+    if (texture)
+        glDeleteTextures(1, &texture);
+}
+
+bool GlyphAtlas::Load(const std::string& font, int pixelSize)
+{
+    return Build(font, pixelSize, 0, 0, false);
+}
+
+bool GlyphAtlas::LoadSDF(const std::string& font, int pixelSize, int fieldSize, int spread)
+{
+    return Build(font, pixelSize, fieldSize, spread, true);
+}
+
+bool GlyphAtlas::Build(const std::string& font, int pixelSize, int fieldSize, int spread, bool distanceField)
+{
+    Close();
+    for (Glyph& glyph : ascii)
+        glyph = Glyph();
+    slots.clear();
+    extended.clear();
+    this->font = font;
+    this->pixelSize = pixelSize;
+    this->fieldSize = fieldSize;
+    this->spread = spread;
+    this->distanceField = distanceField;
+
+    // the font's bytes and everything that shapes the glyphs decide whether a baked atlas still fits
+    MappedFile fontFile(font);
+    if (!fontFile.Data())
+    {
+        std::cout << "ERROR::FREETYPE: Failed to load font " << font << std::endl;
+        return false;
+    }
+    key = HashBytes(fontFile.Data(), fontFile.Size());
+    const int parameters[4] = { pixelSize, fieldSize, spread, distanceField ? 1 : 0 };
+    key = HashValue(parameters, key);
+    if (LoadBaked())
+        return true;
+
+    if (!OpenFace())
+        return false;
+    width = 256;
+    height = 64;
+    pixels.assign((size_t)width * height, 0);
+    penX = PADDING;
+    penY = PADDING;
+    shelf = 0;
+
+    // everything is rasterized first so the tallest glyphs can be packed first,
+    // control codes are skipped, they would only get the missing glyph box
+    std::vector<Bitmap> bitmaps;
+    if (distanceField)
+    {
+        // FreeType is not thread safe, the outlines are read here and only the fields are computed in parallel
+        std::vector<Shape> shapes;
+        for (int c = 32; c < 128; c++)
+        {
+            Shape shape;
+            if (!LoadOutline(face, c, fieldSize, pixelSize, spread, shape, ascii[c]))
+                std::cout << "ERROR::FREETYPE: Failed to load Glyph " << c << std::endl;
+            else if (!shape.edges.empty())
+                shapes.push_back(std::move(shape));
+        }
+        bitmaps.resize(shapes.size());
+        ThreadPool::Shared().ParallelFor((int)shapes.size(), [&](int i) { bitmaps[i] = ComputeField(shapes[i], spread); });
+    }
+    else
+        for (int c = 32; c < 128; c++)
+        {
+            Bitmap bitmap;
+            if (!LoadBitmap(face, c, bitmap, ascii[c]))
+                std::cout << "ERROR::FREETYPE: Failed to load Glyph " << c << std::endl;
+            else if (bitmap.width > 0 && bitmap.height > 0)
+                bitmaps.push_back(std::move(bitmap));
+        }
+    std::sort(bitmaps.begin(), bitmaps.end(), TallerFirst);
+    for (const Bitmap& bitmap : bitmaps)
+        Insert(bitmap.pixels.data(), bitmap.width, bitmap.height, ascii[bitmap.code]);
+    Upload(0, height);
+    Bake();
+    return true;
+}
+
+bool GlyphAtlas::OpenFace()
+{
+    if (face || faceFailed)
+        return face != nullptr;
+    faceFailed = true;
+    if (FT_Init_FreeType(&ft))
+    {
+        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+        ft = nullptr;
+        return false;
+    }
+    if (FT_New_Face(ft, font.c_str(), 0, &face))
+    {
+        std::cout << "ERROR::FREETYPE: Failed to load font " << font << std::endl;
+        face = nullptr;
+        return false;
+    }
+    // distance fields read unscaled outlines, bitmaps are rendered at the face's size
+    if (!distanceField)
+        FT_Set_Pixel_Sizes(face, 0, pixelSize);
+    faceFailed = false;
+    return true;
+}
+
+void GlyphAtlas::Close()
+{
+    if (face)
+        FT_Done_Face(face);
+    if (ft)
+        FT_Done_FreeType(ft);
+    face = nullptr;
+    ft = nullptr;
+    faceFailed = false;
+    baked.Close();
+}
+
+std::string GlyphAtlas::BakedPath() const
+{
+    return std::filesystem::path(font).replace_extension(".atlas").string();
+}
+
+bool GlyphAtlas::LoadBaked()
+{
+    if (!baked.Open(BakedPath()))
+        return false;
+    const unsigned char* data = baked.Data();
+    AtlasFileHeader header;
+    if (baked.Size() < sizeof(header))
+    {
+        baked.Close();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    size_t glyphBytes = sizeof(Glyph) * 128 + (sizeof(uint32_t) + sizeof(Glyph)) * (size_t)header.extendedCount;
+    if (memcmp(header.magic, ATLAS_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != ATLAS_FILE_VERSION
+        || header.key != key || header.glyphSize != sizeof(Glyph)
+        || baked.Size() < sizeof(header) + glyphBytes + (size_t)header.width * header.height)
+    {
+        baked.Close();
+        return false;
+    }
+    data += sizeof(header);
+    memcpy(ascii, data, sizeof(Glyph) * 128);
+    data += sizeof(Glyph) * 128;
+    for (uint32_t i = 0; i < header.extendedCount; i++)
+    {
+        uint32_t code;
+        Glyph glyph;
+        memcpy(&code, data, sizeof(code));
+        memcpy(&glyph, data + sizeof(code), sizeof(glyph));
+        data += sizeof(code) + sizeof(glyph);
+        Remember(code, glyph);
+    }
+    bakedGlyphs = extended.size();
+    width = header.width;
+    height = header.height;
+    penX = header.penX;
+    penY = header.penY;
+    shelf = header.shelf;
+
+    // straight from the mapping to the GPU, the CPU copy is only made once a glyph has to be added
+    pixels.clear();
+    if (!texture)
+        glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    textureWidth = width;
+    textureHeight = height;
+    return true;
+}
+
+void GlyphAtlas::Unmap()
+{
+    if (!pixels.empty() || !baked.Data())
+        return;
+    // the atlas is at the end of the file
+    const unsigned char* bakedPixels = baked.Data() + baked.Size() - (size_t)width * height;
+    pixels.assign(bakedPixels, bakedPixels + (size_t)width * height);
+    baked.Close();
+}
+
+bool GlyphAtlas::Bake()
+{
+    // never truncate the file while it is still mapped
+    Unmap();
+    std::ofstream file(BakedPath(), std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::GLYPH_ATLAS:: could not write " << BakedPath() << std::endl;
+        return false;
+    }
+    AtlasFileHeader header;
+    memcpy(header.magic, ATLAS_FILE_MAGIC, sizeof(header.magic));
+    header.version = ATLAS_FILE_VERSION;
+    header.key = key;
+    header.glyphSize = sizeof(Glyph);
+    header.extendedCount = (uint32_t)extended.size();
+    header.width = width;
+    header.height = height;
+    header.penX = penX;
+    header.penY = penY;
+    header.shelf = shelf;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(ascii), sizeof(ascii));
+    // the table is in probe order, the extended glyphs are written in the order they were added
+    std::vector<uint32_t> codes(extended.size());
+    for (const Slot& slot : slots)
+        if (slot.code)
+            codes[slot.glyph] = slot.code;
+    for (size_t i = 0; i < extended.size(); i++)
+    {
+        file.write(reinterpret_cast<const char*>(&codes[i]), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&extended[i]), sizeof(Glyph));
+    }
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    bakedGlyphs = extended.size();
+    return static_cast<bool>(file);
+}
+
+bool GlyphAtlas::SaveBaked()
+{
+    return extended.size() == bakedGlyphs || Bake();
+}
+
+const Glyph& GlyphAtlas::Find(unsigned int code)
+{
+    if (!slots.empty())
+    {
+        size_t mask = slots.size() - 1;
+        for (size_t i = HashValue(code) & mask; slots[i].code; i = (i + 1) & mask)
+            if (slots[i].code == code)
+                return extended[slots[i].glyph];
+    }
+
+    // first use, missing glyphs are remembered too so they are only looked for once
+    Glyph glyph;
+    if (!Rasterize(code, glyph))
+        glyph = ascii['?'];
+    return Remember(code, glyph);
+}
+
+const Glyph& GlyphAtlas::Remember(unsigned int code, const Glyph& glyph)
+{
+    extended.push_back(glyph);
+    if (extended.size() * 2 > slots.size())
+    {
+        std::vector<Slot> old(std::max<size_t>(64, slots.size() * 2));
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot& slot : old)
+            if (slot.code)
+            {
+                size_t i = HashValue(slot.code) & mask;
+                while (slots[i].code)
+                    i = (i + 1) & mask;
+                slots[i] = slot;
+            }
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = HashValue(code) & mask;
+    while (slots[i].code)
+        i = (i + 1) & mask;
+    slots[i].code = code;
+    slots[i].glyph = (unsigned int)extended.size() - 1;
+    return extended.back();
+}
+
+bool GlyphAtlas::Rasterize(unsigned int code, Glyph& glyph)
+{
+    // a baked atlas opens FreeType only now
+    if (!OpenFace() || FT_Get_Char_Index(face, code) == 0)
+        return false;
+    Bitmap bitmap;
+    if (distanceField)
+    {
+        Shape shape;
+        if (!LoadOutline(face, code, fieldSize, pixelSize, spread, shape, glyph))
+            return false;
+        if (shape.edges.empty())
+            return true;
+        bitmap = ComputeField(shape, spread);
+    }
+    else if (!LoadBitmap(face, code, bitmap, glyph))
+        return false;
+    if (bitmap.width > 0 && bitmap.height > 0)
+    {
+        Unmap();
+        Insert(bitmap.pixels.data(), bitmap.width, bitmap.height, glyph);
+        Upload((int)glyph.UV.y, (int)glyph.UV.w);
+    }
+    return true;
+}
+
+void GlyphAtlas::Insert(const unsigned char* bitmap, int w, int h, Glyph& glyph)
+{
+    glm::ivec2 at = Place(w, h);
+    for (int row = 0; row < h; row++)
+        std::copy_n(bitmap + (size_t)row * w, w, pixels.begin() + (size_t)(at.y + row) * width + at.x);
+    glyph.UV = glm::vec4(at.x, at.y, at.x + w, at.y + h);
+}
+
+glm::ivec2 GlyphAtlas::Place(int w, int h)
+{
+    while (w + 2 * PADDING > width)
+        Resize(width * 2, height);
+    if (penX + w + PADDING > width)
+    {
+        penX = PADDING;
+        penY += shelf + PADDING;
+        shelf = 0;
+    }
+    while (penY + h + PADDING > height)
+        Resize(width, height * 2);
+    glm::ivec2 at(penX, penY);
+    penX += w + PADDING;
+    shelf = std::max(shelf, h);
+    return at;
+}
+
+void GlyphAtlas::Resize(int w, int h)
+{
+    // glyphs keep their texel positions, only the new area is added on the right and bottom
+    std::vector<unsigned char> resized((size_t)w * h, 0);
+    for (int row = 0; row < height; row++)
+        std::copy_n(pixels.begin() + (size_t)row * width, width, resized.begin() + (size_t)row * w);
+    pixels.swap(resized);
+    width = w;
+    height = h;
+}
+
+void GlyphAtlas::Upload(int y0, int y1)
+{
+    if (!texture)
+        glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (width != textureWidth || height != textureHeight)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        textureWidth = width;
+        textureHeight = height;
+    }
+    else if (y1 > y0)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y0, width, y1 - y0, GL_RED, GL_UNSIGNED_BYTE, pixels.data() + (size_t)y0 * width);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,130 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+///////////////////////////////////////////////////////////////////////////////
+// glyph_atlas.h
+// =============
+// All glyphs of a font packed into one single channel texture, so any amount
+// of text can be drawn with that one texture bound (see text_batch.h).
+//
+// Glyph bitmaps are shelf packed, tallest first, with a pixel of padding so
+// linear filtering never bleeds a neighbour in. Each glyph keeps its metrics
+// and its rectangle in the atlas, in texels: the atlas grows downwards when
+// it fills up, texel coordinates stay valid when it does and the text shaders
+// divide by textureSize.
+//
+// LoadSDF stores signed distance fields instead of coverage: the outlines are
+// read unscaled from FreeType and each glyph's field is computed on the thread
+// pool. 0.5 is the outline, the value falls off to 0 and rises to 1 over
+// spread field pixels outside and inside it. TextShaderSDF.fs thresholds it,
+// so one small atlas stays sharp at every text scale. The metrics are in
+// pixelSize units either way, a text scale means the same for both atlases.
+//
+// Printable ASCII is loaded up front and looked up in a flat array. Any other
+// code point is rasterized into the atlas the first time it is asked for and
+// found again through an open addressing hash table, code points the font
+// does not have get the glyph of '?'. Get touches FreeType and GL on a miss,
+// so it belongs on the GL thread like the rest of the text code.
+//
+// The finished atlas and all glyph metrics are baked to <font>.atlas. Later
+// launches map that file and upload the atlas straight from the mapping,
+// FreeType is only started once a glyph is missing from it. SaveBaked writes
+// glyphs added since back, so they are there on the next launch as well.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+struct Glyph
+{
+    glm::vec2 Size = glm::vec2(0.0f);       // bitmap size in pixels
+    glm::vec2 Bearing = glm::vec2(0.0f);    // offset from the pen on the baseline to the bitmap's left/top
+    float Advance = 0.0f;                   // pixels from this pen position to the next
+    glm::vec4 UV = glm::vec4(0.0f);         // atlas rect in texels: u0, v0 (top left), u1, v1
+};
+
+// decodes the UTF-8 sequence at text[i] and moves i past it, malformed bytes come out as U+FFFD
+unsigned int DecodeUTF8(const std::string& text, size_t& i);
+
+class GlyphAtlas
+{
+public:
+    GlyphAtlas() {}
+    ~GlyphAtlas();
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    // rasterizes the printable ASCII code points of font at pixelSize and uploads the atlas,
+    // returns false if the font cannot be opened
+    bool Load(const std::string& font, int pixelSize);
+    // distance field atlas with metrics for pixelSize, the fields are fieldSize pixels per em
+    bool LoadSDF(const std::string& font, int pixelSize, int fieldSize = 32, int spread = 4);
+    // rewrites the baked file if glyphs were added since it was read or written
+    bool SaveBaked();
+
+    // glyph of a code point, rasterized on first use if it is not ASCII
+    const Glyph& Get(unsigned int code)
+    {
+        return code < 128 ? ascii[code] : Find(code);
+    }
+    unsigned int Texture() const { return texture; }
+    int PixelSize() const { return pixelSize; }
+    bool DistanceField() const { return distanceField; }
+    size_t CachedGlyphs() const { return extended.size(); }
+
+private:
+    bool Build(const std::string& font, int pixelSize, int fieldSize, int spread, bool distanceField);
+    // starts FreeType on first need, false if the font cannot be opened
+    bool OpenFace();
+    void Close();
+    std::string BakedPath() const;
+    bool LoadBaked();
+    bool Bake();
+    // copies a mapped atlas into pixels before it is changed
+    void Unmap();
+    const Glyph& Find(unsigned int code);
+    const Glyph& Remember(unsigned int code, const Glyph& glyph);
+    // loads one glyph into the atlas, returns false if the font has no glyph for code
+    bool Rasterize(unsigned int code, Glyph& glyph);
+    // copies a w x h bitmap into the atlas and points glyph's UV at it
+    void Insert(const unsigned char* bitmap, int w, int h, Glyph& glyph);
+    // reserves a w x h rect, growing the atlas when it is full
+    glm::ivec2 Place(int w, int h);
+    void Resize(int w, int h);
+    // uploads the whole atlas if it grew, else rows [y0, y1)
+    void Upload(int y0, int y1);
+
+    Glyph ascii[128];
+    // open addressing with linear probing, at most half full, code 0 marks an empty slot
+    struct Slot { unsigned int code = 0; unsigned int glyph = 0; };
+    std::vector<Slot> slots;
+    std::deque<Glyph> extended;         // stable addresses, Get hands out references
+
+    std::string font;
+    uint64_t key = 0;                   // font bytes and generation parameters
+    MappedFile baked;                   // the baked file until the atlas is first changed
+    size_t bakedGlyphs = 0;             // extended glyphs in the file on disk
+    FT_LibraryRec_* ft = nullptr;
+    FT_FaceRec_* face = nullptr;
+    bool faceFailed = false;
+    int pixelSize = 0;
+    int fieldSize = 0;
+    int spread = 0;
+    bool distanceField = false;
+
+    std::vector<unsigned char> pixels;  // the atlas on the CPU, empty while it is only in the mapping
+    int width = 0, height = 0;
+    int penX = 0, penY = 0, shelf = 0;  // shelf packer position
+    unsigned int texture = 0;
+    int textureWidth = 0, textureHeight = 0;    // size of the storage on the GPU
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a, chain calls through seed to hash several fields
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// hashes the bytes of a value, only for types without padding
+template <typename T>
+inline uint64_t HashValue(const T &value, uint64_t seed = 14695981039346656037ull)
+{
+    return HashBytes(&value, sizeof(T), seed);
+}
+
+#endif
@@ -7,7 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "gl_features.h"
 
+#include <cstddef>
+#include <cstring>
 #include <string>
 #include <vector>
 using namespace std;
@@ -31,6 +34,123 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// which parts of Vertex a mesh actually uses, the GPU buffer only holds those
+enum VertexAttributes {
+    VERTEX_POSITION  = 1 << 0,
+    VERTEX_NORMAL    = 1 << 1,
+    VERTEX_TEXCOORDS = 1 << 2,
+    VERTEX_TANGENTS  = 1 << 3,     // tangent and bitangent
+    VERTEX_BONES     = 1 << 4,     // bone ids and weights
+    VERTEX_ALL       = (1 << 5) - 1
+};
+
+// Packed vertex format for a set of VertexAttributes. Every attribute keeps its shader location,
+// the ones a layout leaves out are disabled and read the generic value (0, 0, 0, 1) instead.
+struct VertexLayout {
+    static const int LOCATIONS = 7;
+    struct Attribute {
+        unsigned int flag;      // VertexAttributes bit it belongs to
+        GLint        components;
+        GLenum       type;
+        size_t       source;    // offset in Vertex
+    };
+    static const Attribute &Describe(int location)
+    {
+        static const Attribute attributes[LOCATIONS] = {
+            { VERTEX_POSITION,  3, GL_FLOAT, offsetof(Vertex, Position) },
+            { VERTEX_NORMAL,    3, GL_FLOAT, offsetof(Vertex, Normal) },
+            { VERTEX_TEXCOORDS, 2, GL_FLOAT, offsetof(Vertex, TexCoords) },
+            { VERTEX_TANGENTS,  3, GL_FLOAT, offsetof(Vertex, Tangent) },
+            { VERTEX_TANGENTS,  3, GL_FLOAT, offsetof(Vertex, Bitangent) },
+            { VERTEX_BONES,     4, GL_INT,   offsetof(Vertex, m_BoneIDs) },
+            { VERTEX_BONES,     4, GL_FLOAT, offsetof(Vertex, m_Weights) },
+        };
+        return attributes[location];
+    }
+
+    unsigned int Attributes;
+    GLsizei      Stride = 0;
+    size_t       Offsets[LOCATIONS];    // in the packed vertex, for the locations the layout has
+
+    explicit VertexLayout(unsigned int attributes = VERTEX_ALL) : Attributes(attributes | VERTEX_POSITION)
+    {
+        for (int location = 0; location < LOCATIONS; location++)
+        {
+            Offsets[location] = Stride;
+            if (Has(location))
+                Stride += Describe(location).components * 4;    // every component is 4 bytes
+        }
+    }
+
+    bool Has(int location) const { return (Attributes & Describe(location).flag) != 0; }
+
+    // the vertices in this layout, ready for glBufferData
+    vector<unsigned char> Pack(const vector<Vertex> &vertices) const
+    {
+        vector<unsigned char> packed(vertices.size() * Stride);
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const unsigned char *from = reinterpret_cast<const unsigned char *>(&vertices[i]);
+            unsigned char *to = packed.data() + i * Stride;
+            for (int location = 0; location < LOCATIONS; location++)
+                if (Has(location))
+                    memcpy(to + Offsets[location], from + Describe(location).source, Describe(location).components * 4);
+        }
+        return packed;
+    }
+
+    // the inverse of Pack, what the layout leaves out comes back zeroed
+    vector<Vertex> Unpack(const unsigned char *packed, size_t count) const
+    {
+        vector<Vertex> vertices(count, Vertex());
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned char *to = reinterpret_cast<unsigned char *>(&vertices[i]);
+            const unsigned char *from = packed + i * Stride;
+            for (int location = 0; location < LOCATIONS; location++)
+                if (Has(location))
+                    memcpy(to + Describe(location).source, from + Offsets[location], Describe(location).components * 4);
+        }
+        return vertices;
+    }
+
+    // points the attributes of the bound vertex array at the bound array buffer, vertices starting at base bytes
+    void Apply(size_t base = 0) const
+    {
+        for (GLuint location = 0; location < LOCATIONS; location++)
+        {
+            if (!Has(location))
+            {
+                glDisableVertexAttribArray(location);
+                continue;
+            }
+            const Attribute &attribute = Describe(location);
+            const void *offset = reinterpret_cast<const void *>(base + Offsets[location]);
+            glEnableVertexAttribArray(location);
+            if (attribute.type == GL_INT)
+                glVertexAttribIPointer(location, attribute.components, attribute.type, Stride, offset);
+            else
+                glVertexAttribPointer(location, attribute.components, attribute.type, GL_FALSE, Stride, offset);
+        }
+    }
+};
+
+// where a mesh's indices sit inside a vertex array shared with other meshes, see geometry_pool.h
+struct GeometryRange {
+    unsigned int VAO = 0;
+    GLuint       FirstIndex = 0;    // in the shared index buffer
+    GLsizei      IndexCount = 0;
+    GLint        BaseVertex = 0;    // added to every index
+    GLsizei      VertexCount = 0;
+};
+
+// one level of detail inside a mesh's indices, level 0 is the full mesh (see mesh_lod.h)
+struct MeshLevel {
+    GLuint  FirstIndex;     // relative to the mesh's first index
+    GLsizei IndexCount;
+    float   Error;          // how far the surface may be off, in mesh units
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -39,67 +159,171 @@ struct Texture {
 
 class Mesh {
 public:
-    // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
+    // mesh Data, the vertices and indices themselves only live on the GPU
+    size_t               VertexCount;
+    size_t               IndexCount;
     vector<Texture>      textures;
+    VertexLayout         Layout;
     unsigned int VAO;
+    // where the mesh starts in VAO's buffers, not 0 when they are shared with other meshes
+    GLuint       FirstIndex = 0;
+    GLint        BaseVertex = 0;
+    // index ranges of the levels of detail in indices, finest first, and the one Draw uses
+    vector<MeshLevel> Levels;
+    int          Level = 0;
+    // layer and UV rect of the diffuse texture inside a texture array, see texture_array.h (layer -1: not packed)
+    int          AtlasLayer = -1;
+    glm::vec4    AtlasRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, attributes are the VertexAttributes the vertices really carry.
+    // without levels the indices are a single level, else they hold every level as FlattenLods lays them out
+    Mesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, vector<Texture> textures, unsigned int attributes = VERTEX_ALL,
+         vector<MeshLevel> levels = vector<MeshLevel>())
+        : VertexCount(vertices.size()), IndexCount(indices.size()), textures(std::move(textures)), Layout(attributes)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        setLevels(std::move(levels));
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(vertices, indices);
+    }
+
+    // constructor for a mesh whose vertices and indices were already placed in shared buffers
+    Mesh(vector<Texture> textures, unsigned int attributes, const GeometryRange &range, vector<MeshLevel> levels = vector<MeshLevel>())
+        : VertexCount(range.VertexCount), IndexCount(range.IndexCount), textures(std::move(textures)), Layout(attributes),
+          VAO(range.VAO), FirstIndex(range.FirstIndex), BaseVertex(range.BaseVertex), VBO(0), EBO(0)
+    {
+        setLevels(std::move(levels));
     }
 
     // render the mesh
     void Draw(Shader &shader) 
     {
-        // bind appropriate textures
+        Bind(shader);
+        glBindVertexArray(VAO);
+        DrawElements();
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the textures and sets the atlas attributes, Model binds the vertex array itself when meshes share one
+    void Bind(Shader &shader)
+    {
+        // texture units come from the table made on the first draw with this shader, no names are built or looked up
+        const SamplerTable &table = samplerTable(shader);
+        GLuint ids[MAX_SAMPLERS];
+        for(size_t i = 0; i < table.textures.size(); i++)
+            ids[i] = textures[table.textures[i]].id;
+        if(table.contiguous && !table.textures.empty() && glFeatures.MultiBind)
+            glBindTextures(table.units[0], static_cast<GLsizei>(table.textures.size()), ids);
+        else
+        {
+            for(size_t i = 0; i < table.textures.size(); i++)
+            {
+                glActiveTexture(GL_TEXTURE0 + table.units[i]);
+                glBindTexture(GL_TEXTURE_2D, ids[i]);
+            }
+        }
+
+        // attributes 7 and 8 have no array behind them, the current value is the same for every vertex
+        if (AtlasLayer >= 0)
+        {
+            glVertexAttrib4fv(7, &AtlasRect[0]);
+            glVertexAttrib1f(8, (float)AtlasLayer);
+        }
+    }
+
+    // draws the triangles of the selected level from the bound vertex array
+    void DrawElements() const
+    {
+        const MeshLevel &level = CurrentLevel();
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.IndexCount, GL_UNSIGNED_INT,
+                                 reinterpret_cast<const void *>((FirstIndex + level.FirstIndex) * sizeof(unsigned int)), BaseVertex);
+    }
+
+    const MeshLevel &CurrentLevel() const
+    {
+        return Levels[Level < 0 ? 0 : Level >= static_cast<int>(Levels.size()) ? Levels.size() - 1 : Level];
+    }
+
+    // the selected level as a range of the mesh's vertex array, for GeometryPool::Queue
+    GeometryRange LevelRange() const
+    {
+        const MeshLevel &level = CurrentLevel();
+        GeometryRange range;
+        range.VAO = VAO;
+        range.FirstIndex = FirstIndex + level.FirstIndex;
+        range.IndexCount = level.IndexCount;
+        range.BaseVertex = BaseVertex;
+        range.VertexCount = static_cast<GLsizei>(VertexCount);
+        return range;
+    }
+
+private:
+    static const size_t MAX_SAMPLERS = 16;
+
+    // which texture goes to which unit for one shader
+    struct SamplerTable {
+        unsigned int   shader;
+        vector<size_t> textures;    // indices into textures, the ones the shader has no sampler for are left out
+        vector<GLuint> units;       // per entry of textures
+        bool           contiguous;  // units run up by one from units[0], one glBindTextures covers them
+    };
+
+    // render data 
+    unsigned int VBO, EBO;
+    vector<SamplerTable> samplerTables;     // a mesh is drawn with a shader or two, a short list is enough
+
+    void setLevels(vector<MeshLevel> levels)
+    {
+        Levels = std::move(levels);
+        if(Levels.empty())
+            Levels.push_back({ 0, static_cast<GLsizei>(IndexCount), 0.0f });
+    }
+
+    // the table for a shader, resolved from the sampler names the first time the mesh is drawn with it
+    const SamplerTable &samplerTable(Shader &shader)
+    {
+        for(const SamplerTable &table : samplerTables)
+            if(table.shader == shader.ID)
+                return table;
+
+        SamplerTable table;
+        table.shader = shader.ID;
+        table.contiguous = true;
+        // the N in texture_diffuseN counts the textures of a type in the order the mesh lists them
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        for(size_t i = 0; i < textures.size() && table.textures.size() < MAX_SAMPLERS; i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
+                number = std::to_string(specularNr++);
             else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+                number = std::to_string(normalNr++);
+            else if(name == "texture_height")
+                number = std::to_string(heightNr++);
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+            int unit = shader.samplerUnit(name + number);
+            if(unit < 0)
+                continue;
+            if(!table.units.empty() && static_cast<GLuint>(unit) != table.units.back() + 1)
+                table.contiguous = false;
+            table.textures.push_back(i);
+            table.units.push_back(static_cast<GLuint>(unit));
+        }
+        samplerTables.push_back(table);
+        return samplerTables.back();
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
@@ -107,39 +331,16 @@ private:
         glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
-        // load data into vertex buffers
+        // load data into vertex buffers, only the attributes of the mesh's layout make it to the GPU
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        vector<unsigned char> packed = Layout.Pack(vertices);
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        Layout.Apply();
         glBindVertexArray(0);
     }
 };
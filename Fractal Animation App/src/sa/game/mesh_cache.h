@@ -0,0 +1,387 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+#include "hash.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a simplified version of a mesh over the same vertices, see mesh_lod.h
+struct MeshLod {
+    vector<unsigned int> indices;
+    float                error;     // how far the surface may be off, in mesh units
+};
+
+// CPU side geometry of one mesh, what gets written to and read from the binary geometry format
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    unsigned int         attributes = VERTEX_ALL;  // VertexAttributes the vertices carry
+    vector<MeshLod>      lods;                      // coarser levels, finest first
+};
+
+// level of detail lists after a mesh's indices: count, then per level index count, error and the indices
+inline void WriteMeshLods(ofstream &file, const MeshData &mesh)
+{
+    uint32_t count = static_cast<uint32_t>(mesh.lods.size());
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (const MeshLod &lod : mesh.lods)
+    {
+        uint32_t indexCount = static_cast<uint32_t>(lod.indices.size());
+        file.write(reinterpret_cast<const char *>(&indexCount), sizeof(indexCount));
+        file.write(reinterpret_cast<const char *>(&lod.error), sizeof(lod.error));
+        file.write(reinterpret_cast<const char *>(lod.indices.data()), lod.indices.size() * sizeof(unsigned int));
+    }
+}
+
+// a texture a mesh's material refers to, path is relative to the model's directory
+struct MaterialTexture {
+    string type;    // texture_diffuse, texture_specular, texture_normal or texture_height
+    string path;
+};
+
+// one node of a model's hierarchy, meshes index into ModelData::meshes
+struct NodeData {
+    glm::mat4            transform;     // relative to the parent
+    int                  parent;        // -1 for the root, parents come before their children
+    vector<unsigned int> meshes;
+};
+
+// everything Model keeps from an import, what the binary model format holds
+struct ModelData {
+    vector<MeshData>                meshes;
+    vector<vector<MaterialTexture>> materials;  // per mesh
+    vector<NodeData>                nodes;
+};
+
+// moves a cache file written to temporary over path once it is complete, so a crash or a full disk
+// never leaves a truncated file at path. ok is whether writing succeeded, the temporary is deleted if not
+inline bool ReplaceCacheFile(const string &temporary, const string &path, bool ok)
+{
+    if (ok && rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        // rename does not replace an existing file on Windows
+        remove(path.c_str());
+        ok = rename(temporary.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        cout << "ERROR::MESH_CACHE:: could not write " << path << endl;
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+// bounds checked reads from a mapped cache file
+struct CacheFileReader {
+    const unsigned char *at;
+    const unsigned char *end;
+
+    bool Read(void *data, size_t size)
+    {
+        if (static_cast<size_t>(end - at) < size)
+            return false;
+        memcpy(data, at, size);
+        at += size;
+        return true;
+    }
+    // whether count items of at least minBytes each can still follow, checked before anything is resized
+    bool Holds(size_t count, size_t minBytes) const
+    {
+        return count <= static_cast<size_t>(end - at) / minBytes;
+    }
+    bool ReadString(string &text)
+    {
+        uint32_t length;
+        if (!Read(&length, sizeof(length)) || static_cast<size_t>(end - at) < length)
+            return false;
+        text.assign(reinterpret_cast<const char *>(at), length);
+        at += length;
+        return true;
+    }
+};
+
+// whether every index refers to one of vertexCount vertices, a bad one would be fetched out of range on the GPU
+inline bool IndicesInRange(const vector<unsigned int> &indices, uint32_t vertexCount)
+{
+    for (unsigned int index : indices)
+        if (index >= vertexCount)
+            return false;
+    return true;
+}
+
+// attribute masks a cache file may hold, positions are always there so a vertex is never zero bytes
+inline bool ValidAttributes(uint32_t attributes)
+{
+    return (attributes & VERTEX_POSITION) && (attributes & ~static_cast<uint32_t>(VERTEX_ALL)) == 0;
+}
+
+// binary geometry format
+// ---------------------
+// header, then per mesh: vertex count, index count, attribute mask, the vertices packed in the VertexLayout of that mask,
+// the indices and the lods.
+// key identifies whatever produced the geometry (source file, import flags, field parameters).
+// Loads read from a memory mapping, a file with a different key or version is treated as missing.
+const char MESH_FILE_MAGIC[4] = { 'S', 'A', 'M', 'B' };
+const uint32_t MESH_FILE_VERSION = 4;
+
+struct MeshFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertexSize;    // sizeof(Vertex) when written, guards against layout changes
+    uint32_t meshCount;
+};
+
+inline bool SaveMeshFile(const string &path, uint64_t key, const vector<MeshData> &meshes)
+{
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "ERROR::MESH_CACHE:: could not write " << path << endl;
+        return false;
+    }
+    MeshFileHeader header;
+    memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+    header.version = MESH_FILE_VERSION;
+    header.key = key;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const MeshData &mesh : meshes)
+    {
+        uint32_t counts[3] = { static_cast<uint32_t>(mesh.vertices.size()), static_cast<uint32_t>(mesh.indices.size()), mesh.attributes };
+        file.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+        vector<unsigned char> packed = VertexLayout(mesh.attributes).Pack(mesh.vertices);
+        file.write(reinterpret_cast<const char *>(packed.data()), packed.size());
+        file.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        WriteMeshLods(file, mesh);
+    }
+    file.close();
+    return ReplaceCacheFile(temporary, path, !file.fail());
+}
+
+// returns false if the file is missing, stale (different key or version), truncated or inconsistent
+inline bool LoadMeshFile(const string &path, uint64_t key, vector<MeshData> &meshes)
+{
+    MappedFile file(path);
+    if (!file.Data())
+        return false;
+    CacheFileReader reader = { file.Data(), file.Data() + file.Size() };
+    MeshFileHeader header;
+    if (!reader.Read(&header, sizeof(header)))
+        return false;
+    if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_FILE_VERSION
+        || header.key != key || header.vertexSize != sizeof(Vertex))
+        return false;
+    // the smallest mesh is its counts and a lod count
+    if (!reader.Holds(header.meshCount, 3 * sizeof(uint32_t) + sizeof(uint32_t)))
+        return false;
+    meshes.assign(header.meshCount, MeshData());
+    for (MeshData &mesh : meshes)
+    {
+        uint32_t counts[3];
+        if (!reader.Read(counts, sizeof(counts)) || !ValidAttributes(counts[2]))
+            return false;
+        VertexLayout layout(counts[2]);
+        if (!reader.Holds(counts[0], layout.Stride) || !reader.Holds(counts[1], sizeof(unsigned int)))
+            return false;
+        size_t vertexBytes = counts[0] * static_cast<size_t>(layout.Stride);
+        if (static_cast<size_t>(reader.end - reader.at) < vertexBytes + counts[1] * sizeof(unsigned int))
+            return false;
+        // unpacked straight from the mapping
+        mesh.vertices = layout.Unpack(reader.at, counts[0]);
+        reader.at += vertexBytes;
+        mesh.attributes = counts[2];
+        mesh.indices.resize(counts[1]);
+        reader.Read(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        if (!IndicesInRange(mesh.indices, counts[0]))
+            return false;
+        uint32_t lodCount;
+        // a lod is at least its index count and error
+        if (!reader.Read(&lodCount, sizeof(lodCount)) || !reader.Holds(lodCount, sizeof(uint32_t) + sizeof(float)))
+            return false;
+        mesh.lods.resize(lodCount);
+        for (MeshLod &lod : mesh.lods)
+        {
+            uint32_t indexCount;
+            if (!reader.Read(&indexCount, sizeof(indexCount)) || !reader.Read(&lod.error, sizeof(lod.error))
+                || !reader.Holds(indexCount, sizeof(unsigned int)))
+                return false;
+            lod.indices.resize(indexCount);
+            reader.Read(lod.indices.data(), indexCount * sizeof(unsigned int));
+            if (!IndicesInRange(lod.indices, counts[0]))
+                return false;
+        }
+    }
+    return true;
+}
+
+// binary model format
+// ------------------
+// header, then per mesh: vertex, index and texture counts, attribute mask, the packed vertices as in the geometry format, the indices, the lods
+// as in the geometry format and each texture as type and path (length prefixed), then per node: transform, parent, mesh count
+// and mesh indices. key is the source file's hash combined with the import flags. Loads read
+// from a memory mapping, a file with a different key or version is treated as missing.
+const char MODEL_FILE_MAGIC[4] = { 'S', 'A', 'M', 'M' };
+const uint32_t MODEL_FILE_VERSION = 4;
+
+struct ModelFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t vertexSize;    // sizeof(Vertex) when written, guards against layout changes
+    uint32_t meshCount;
+    uint32_t nodeCount;
+};
+
+inline void WriteModelString(ofstream &file, const string &text)
+{
+    uint32_t length = static_cast<uint32_t>(text.size());
+    file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    file.write(text.data(), length);
+}
+
+inline bool SaveModelFile(const string &path, uint64_t key, const ModelData &model)
+{
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "ERROR::MESH_CACHE:: could not write " << path << endl;
+        return false;
+    }
+    ModelFileHeader header;
+    memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.key = key;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(model.meshes.size());
+    header.nodeCount = static_cast<uint32_t>(model.nodes.size());
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (size_t i = 0; i < model.meshes.size(); i++)
+    {
+        const MeshData &mesh = model.meshes[i];
+        const vector<MaterialTexture> &textures = model.materials[i];
+        uint32_t counts[4] = { static_cast<uint32_t>(mesh.vertices.size()), static_cast<uint32_t>(mesh.indices.size()),
+                               static_cast<uint32_t>(textures.size()), mesh.attributes };
+        file.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+        vector<unsigned char> packed = VertexLayout(mesh.attributes).Pack(mesh.vertices);
+        file.write(reinterpret_cast<const char *>(packed.data()), packed.size());
+        file.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        WriteMeshLods(file, mesh);
+        for (const MaterialTexture &texture : textures)
+        {
+            WriteModelString(file, texture.type);
+            WriteModelString(file, texture.path);
+        }
+    }
+    for (const NodeData &node : model.nodes)
+    {
+        int32_t parent = node.parent;
+        uint32_t meshCount = static_cast<uint32_t>(node.meshes.size());
+        file.write(reinterpret_cast<const char *>(&node.transform), sizeof(node.transform));
+        file.write(reinterpret_cast<const char *>(&parent), sizeof(parent));
+        file.write(reinterpret_cast<const char *>(&meshCount), sizeof(meshCount));
+        file.write(reinterpret_cast<const char *>(node.meshes.data()), node.meshes.size() * sizeof(unsigned int));
+    }
+    file.close();
+    return ReplaceCacheFile(temporary, path, !file.fail());
+}
+
+// returns false if the file is missing, stale (different key or version), truncated or inconsistent
+inline bool LoadModelFile(const string &path, uint64_t key, ModelData &model)
+{
+    MappedFile file(path);
+    if (!file.Data())
+        return false;
+    CacheFileReader reader = { file.Data(), file.Data() + file.Size() };
+    ModelFileHeader header;
+    if (!reader.Read(&header, sizeof(header)))
+        return false;
+    if (memcmp(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != MODEL_FILE_VERSION
+        || header.key != key || header.vertexSize != sizeof(Vertex))
+        return false;
+    // the smallest mesh is its counts and a lod count, the smallest node its transform, parent and mesh count
+    const size_t minMesh = 4 * sizeof(uint32_t) + sizeof(uint32_t);
+    const size_t minNode = sizeof(glm::mat4) + sizeof(int32_t) + sizeof(uint32_t);
+    if (!reader.Holds(header.meshCount, minMesh))
+        return false;
+    model.meshes.resize(header.meshCount);
+    model.materials.resize(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++)
+    {
+        MeshData &mesh = model.meshes[i];
+        uint32_t counts[4];
+        if (!reader.Read(counts, sizeof(counts)) || !ValidAttributes(counts[3]))
+            return false;
+        VertexLayout layout(counts[3]);
+        if (!reader.Holds(counts[0], layout.Stride) || !reader.Holds(counts[1], sizeof(unsigned int)))
+            return false;
+        size_t vertexBytes = counts[0] * static_cast<size_t>(layout.Stride);
+        if (static_cast<size_t>(reader.end - reader.at) < vertexBytes + counts[1] * sizeof(unsigned int))
+            return false;
+        // unpacked straight from the mapping
+        mesh.vertices = layout.Unpack(reader.at, counts[0]);
+        reader.at += vertexBytes;
+        mesh.indices.resize(counts[1]);
+        mesh.attributes = counts[3];
+        reader.Read(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        if (!IndicesInRange(mesh.indices, counts[0]))
+            return false;
+        uint32_t lodCount;
+        // a lod is at least its index count and error
+        if (!reader.Read(&lodCount, sizeof(lodCount)) || !reader.Holds(lodCount, sizeof(uint32_t) + sizeof(float)))
+            return false;
+        mesh.lods.resize(lodCount);
+        for (MeshLod &lod : mesh.lods)
+        {
+            uint32_t indexCount;
+            if (!reader.Read(&indexCount, sizeof(indexCount)) || !reader.Read(&lod.error, sizeof(lod.error))
+                || !reader.Holds(indexCount, sizeof(unsigned int)))
+                return false;
+            lod.indices.resize(indexCount);
+            reader.Read(lod.indices.data(), indexCount * sizeof(unsigned int));
+            if (!IndicesInRange(lod.indices, counts[0]))
+                return false;
+        }
+        // a texture is at least its two string lengths
+        if (!reader.Holds(counts[2], 2 * sizeof(uint32_t)))
+            return false;
+        model.materials[i].resize(counts[2]);
+        for (MaterialTexture &texture : model.materials[i])
+            if (!reader.ReadString(texture.type) || !reader.ReadString(texture.path))
+                return false;
+    }
+    if (!reader.Holds(header.nodeCount, minNode))
+        return false;
+    model.nodes.resize(header.nodeCount);
+    for (uint32_t i = 0; i < header.nodeCount; i++)
+    {
+        NodeData &node = model.nodes[i];
+        int32_t parent;
+        uint32_t meshCount;
+        if (!reader.Read(&node.transform, sizeof(node.transform)) || !reader.Read(&parent, sizeof(parent))
+            || !reader.Read(&meshCount, sizeof(meshCount)) || !reader.Holds(meshCount, sizeof(unsigned int)))
+            return false;
+        // parents come before their children
+        if (parent < -1 || parent >= static_cast<int32_t>(i))
+            return false;
+        node.parent = parent;
+        node.meshes.resize(meshCount);
+        reader.Read(node.meshes.data(), meshCount * sizeof(unsigned int));
+        if (!IndicesInRange(node.meshes, header.meshCount))
+            return false;
+    }
+    return true;
+}
+#endif
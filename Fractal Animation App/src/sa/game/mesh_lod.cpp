@@ -0,0 +1,409 @@
+// Quadric error simplification and level selection, see mesh_lod.h
+
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+#include "hash.h"
+#include "icosphere.h"
+
+namespace
+{
+    // symmetric 4x4 matrix of summed plane equations, the squared distance of p to all planes is p^T Q p
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        void AddPlane(glm::dvec3 n, double d)
+        {
+            a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+            b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+            c2 += n.z * n.z; cd += n.z * d;
+            d2 += d * d;
+        }
+        void Add(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+            bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        }
+        double Error(glm::dvec3 p) const
+        {
+            double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                     + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                     + c2 * p.z * p.z + 2 * cd * p.z + d2;
+            return std::max(e, 0.0);
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        unsigned int from, to;
+        unsigned int fromVersion, toVersion;
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    // Half edge collapses on the welded positions of a mesh. Triangles keep the original vertex of each
+    // corner, a corner moved onto another position takes the vertex there that looks most like it.
+    class Simplifier
+    {
+    public:
+        Simplifier(const MeshData& mesh) : mesh(mesh)
+        {
+            weld();
+            buildQuadrics();
+            for (unsigned int v = 0; v < positions.size(); v++)
+                pushEdges(v);
+        }
+
+        // collapses until the cheapest collapse left costs more than maxError, returns the largest error reached
+        float Run(float maxError)
+        {
+            double limit = (double)maxError * maxError;
+            while (!heap.empty())
+            {
+                Collapse collapse = heap.top();
+                if (collapse.cost > limit)
+                    break;
+                heap.pop();
+                unsigned int u = collapse.from, v = collapse.to;
+                if (removed[u] || removed[v] || version[u] != collapse.fromVersion || version[v] != collapse.toVersion)
+                    continue;
+                if (!canCollapse(u, v))
+                    continue;
+                apply(u, v);
+                reached = std::max(reached, collapse.cost);
+            }
+            return (float)std::sqrt(reached);
+        }
+
+        std::vector<unsigned int> Indices() const
+        {
+            std::vector<unsigned int> indices;
+            indices.reserve(liveTriangles * 3);
+            for (size_t t = 0; t < alive.size(); t++)
+                if (alive[t])
+                    indices.insert(indices.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+            return indices;
+        }
+
+        size_t Triangles() const { return liveTriangles; }
+
+    private:
+        void weld()
+        {
+            // positions are compared bit for bit, shared vertices of a seam were made from the same float
+            struct Key
+            {
+                glm::vec3 p;
+                bool operator==(const Key& other) const { return memcmp(&p, &other.p, sizeof(p)) == 0; }
+            };
+            struct KeyHash
+            {
+                size_t operator()(const Key& key) const { return (size_t)HashValue(key.p); }
+            };
+            std::unordered_map<Key, unsigned int, KeyHash> lookup;
+            lookup.reserve(mesh.vertices.size());
+            welded.resize(mesh.vertices.size());
+            for (size_t i = 0; i < mesh.vertices.size(); i++)
+            {
+                glm::vec3 p = mesh.vertices[i].Position;
+                auto found = lookup.emplace(Key{ p }, (unsigned int)positions.size());
+                if (found.second)
+                {
+                    positions.push_back(glm::dvec3(p));
+                    members.emplace_back();
+                }
+                welded[i] = found.first->second;
+                members[welded[i]].push_back((unsigned int)i);
+            }
+
+            size_t count = positions.size();
+            removed.assign(count, false);
+            version.assign(count, 0);
+            triangles.resize(count);
+            for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+            {
+                unsigned int a = welded[mesh.indices[t]], b = welded[mesh.indices[t + 1]], c = welded[mesh.indices[t + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                unsigned int id = (unsigned int)alive.size();
+                corners.insert(corners.end(), mesh.indices.begin() + t, mesh.indices.begin() + t + 3);
+                alive.push_back(true);
+                triangles[a].push_back(id);
+                triangles[b].push_back(id);
+                triangles[c].push_back(id);
+            }
+            liveTriangles = alive.size();
+        }
+
+        unsigned int at(size_t triangle, int corner) const { return welded[corners[triangle * 3 + corner]]; }
+
+        void buildQuadrics()
+        {
+            quadrics.resize(positions.size());
+            // edges used by one triangle are borders, counted through an ordered key
+            std::unordered_map<uint64_t, int> edgeUse;
+            for (size_t t = 0; t < alive.size(); t++)
+            {
+                glm::dvec3 p0 = positions[at(t, 0)], p1 = positions[at(t, 1)], p2 = positions[at(t, 2)];
+                glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+                double length = glm::length(n);
+                if (length > 0.0)
+                {
+                    n /= length;
+                    for (int k = 0; k < 3; k++)
+                        quadrics[at(t, k)].AddPlane(n, -glm::dot(n, p0));
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = at(t, k), b = at(t, (k + 1) % 3);
+                    edgeUse[(uint64_t)std::min(a, b) << 32 | std::max(a, b)]++;
+                }
+            }
+            // a border gets a plane through it at a right angle to its triangle, sliding along it is free, leaving it is not
+            for (size_t t = 0; t < alive.size(); t++)
+            {
+                glm::dvec3 p[3] = { positions[at(t, 0)], positions[at(t, 1)], positions[at(t, 2)] };
+                glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = at(t, k), b = at(t, (k + 1) % 3);
+                    if (edgeUse[(uint64_t)std::min(a, b) << 32 | std::max(a, b)] != 1)
+                        continue;
+                    glm::dvec3 n = glm::cross(p[(k + 1) % 3] - p[k], normal);
+                    double length = glm::length(n);
+                    if (length == 0.0)
+                        continue;
+                    n /= length;
+                    quadrics[a].AddPlane(n, -glm::dot(n, p[k]));
+                    quadrics[b].AddPlane(n, -glm::dot(n, p[k]));
+                }
+            }
+        }
+
+        // positions sharing a live triangle with v
+        void neighbours(unsigned int v, std::vector<unsigned int>& out) const
+        {
+            out.clear();
+            for (unsigned int t : triangles[v])
+                if (alive[t])
+                    for (int k = 0; k < 3; k++)
+                        if (at(t, k) != v)
+                            out.push_back(at(t, k));
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        }
+
+        void pushEdges(unsigned int v)
+        {
+            neighbours(v, scratch);
+            for (unsigned int w : scratch)
+            {
+                Quadric q = quadrics[v];
+                q.Add(quadrics[w]);
+                heap.push({ q.Error(positions[w]), v, w, version[v], version[w] });
+                heap.push({ q.Error(positions[v]), w, v, version[w], version[v] });
+            }
+        }
+
+        bool canCollapse(unsigned int u, unsigned int v)
+        {
+            // the positions next to both ends must be exactly the far corners of the triangles on the edge,
+            // anything else would join two sheets of the surface
+            std::vector<unsigned int> nu, nv, shared;
+            neighbours(u, nu);
+            neighbours(v, nv);
+            std::set_intersection(nu.begin(), nu.end(), nv.begin(), nv.end(), std::back_inserter(shared));
+            size_t onEdge = 0;
+            for (unsigned int t : triangles[u])
+                if (alive[t] && (at(t, 0) == v || at(t, 1) == v || at(t, 2) == v))
+                    onEdge++;
+            if (shared.size() != onEdge)
+                return false;
+
+            // no triangle that stays may turn over or collapse to a sliver
+            for (unsigned int t : triangles[u])
+            {
+                if (!alive[t] || at(t, 0) == v || at(t, 1) == v || at(t, 2) == v)
+                    continue;
+                glm::dvec3 before[3], after[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    before[k] = positions[at(t, k)];
+                    after[k] = at(t, k) == u ? positions[v] : before[k];
+                }
+                glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                double l0 = glm::length(n0), l1 = glm::length(n1);
+                if (l1 <= 1e-12 * std::max(l0, 1e-30) || glm::dot(n0, n1) < 0.2 * l0 * l1)
+                    return false;
+            }
+            return true;
+        }
+
+        // the vertex at position v that can stand in for original vertex from
+        unsigned int closestVertex(unsigned int from, unsigned int v) const
+        {
+            const Vertex& a = mesh.vertices[from];
+            unsigned int best = members[v][0];
+            float bestScore = 1e30f;
+            for (unsigned int candidate : members[v])
+            {
+                const Vertex& b = mesh.vertices[candidate];
+                float score = 0.0f;
+                if (mesh.attributes & VERTEX_NORMAL)
+                    score += 1.0f - glm::dot(a.Normal, b.Normal);
+                if (mesh.attributes & VERTEX_TEXCOORDS)
+                    score += glm::length(a.TexCoords - b.TexCoords);
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    best = candidate;
+                }
+            }
+            return best;
+        }
+
+        void apply(unsigned int u, unsigned int v)
+        {
+            for (unsigned int t : triangles[u])
+            {
+                if (!alive[t])
+                    continue;
+                if (at(t, 0) == v || at(t, 1) == v || at(t, 2) == v)
+                {
+                    alive[t] = false;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++)
+                    if (at(t, k) == u)
+                        corners[t * 3 + k] = closestVertex(corners[t * 3 + k], v);
+                triangles[v].push_back(t);
+            }
+            triangles[u].clear();
+            std::vector<unsigned int>& list = triangles[v];
+            list.erase(std::remove_if(list.begin(), list.end(), [&](unsigned int t) { return !alive[t]; }), list.end());
+
+            quadrics[v].Add(quadrics[u]);
+            removed[u] = true;
+            version[v]++;
+            // the costs of every edge around v changed with its quadric
+            pushEdges(v);
+        }
+
+        const MeshData& mesh;
+        std::vector<unsigned int> welded;                   // original vertex -> position
+        std::vector<glm::dvec3> positions;
+        std::vector<std::vector<unsigned int>> members;     // position -> original vertices there
+        std::vector<Quadric> quadrics;
+        std::vector<bool> removed;
+        std::vector<unsigned int> version;                  // bumped when a position's quadric changes
+        std::vector<std::vector<unsigned int>> triangles;   // position -> triangles using it, dead ones dropped lazily
+        std::vector<unsigned int> corners;                  // original vertex per triangle corner
+        std::vector<bool> alive;
+        size_t liveTriangles = 0;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+        std::vector<unsigned int> scratch;
+        double reached = 0.0;
+    };
+}
+
+uint64_t HashLodSettings(const LodSettings& settings, uint64_t seed)
+{
+    uint64_t hash = HashBytes(settings.errors.data(), settings.errors.size() * sizeof(float), seed);
+    return HashValue(settings.minReduction, hash);
+}
+
+void BuildLods(MeshData& mesh, const LodSettings& settings)
+{
+    mesh.lods.clear();
+    if (mesh.vertices.empty() || mesh.indices.size() < 3 || settings.errors.empty())
+        return;
+    glm::vec3 low = mesh.vertices[0].Position, high = low;
+    for (const Vertex& vertex : mesh.vertices)
+    {
+        low = glm::min(low, vertex.Position);
+        high = glm::max(high, vertex.Position);
+    }
+    float diagonal = glm::length(high - low);
+
+    // one pass, a copy of the index list each time it gets past the next error
+    Simplifier simplifier(mesh);
+    size_t previous = mesh.indices.size() / 3;
+    for (float error : settings.errors)
+    {
+        float reached = simplifier.Run(error * diagonal);
+        size_t triangles = simplifier.Triangles();
+        if (triangles == 0)
+            break;
+        if (triangles > previous * settings.minReduction)
+            continue;
+        mesh.lods.push_back({ simplifier.Indices(), reached });
+        previous = triangles;
+    }
+}
+
+std::vector<unsigned int> FlattenLods(const MeshData& mesh, std::vector<MeshLevel>& levels)
+{
+    std::vector<unsigned int> indices = mesh.indices;
+    levels.assign(1, { 0, (GLsizei)mesh.indices.size(), 0.0f });
+    for (const MeshLod& lod : mesh.lods)
+    {
+        levels.push_back({ (GLuint)indices.size(), (GLsizei)lod.indices.size(), lod.error });
+        indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+    }
+    return indices;
+}
+
+int SelectLevel(const std::vector<MeshLevel>& levels, float distance, float scale, float zoom, float screenHeight, float pixelError)
+{
+    if (distance <= 0.0f)
+        return 0;
+    // pixels one unit covers at that distance, the view spans 2 tan(fov / 2) units per unit of distance
+    float pixelsPerUnit = screenHeight / (2.0f * distance * std::tan(glm::radians(zoom) * 0.5f));
+    int level = 0;
+    for (int i = 1; i < (int)levels.size(); i++)
+        if (levels[i].Error * scale * pixelsPerUnit <= pixelError)
+            level = i;
+    return level;
+}
+
+MeshData LoadOrBuildIcosphere(const std::string& cachePath, float radius, int subdivision, bool smooth, const LodSettings& settings)
+{
+    uint64_t key = HashValue(radius);
+    key = HashValue(subdivision, key);
+    key = HashValue(smooth, key);
+    key = HashLodSettings(settings, key);
+    vector<MeshData> meshes;
+    if (LoadMeshFile(cachePath, key, meshes) && meshes.size() == 1)
+        return meshes[0];
+
+    // interleaved position, normal and texture coordinates, the layout Icosphere::draw uses
+    Icosphere sphere(radius, subdivision, smooth);
+    const float* data = sphere.getInterleavedVertices();
+    MeshData mesh;
+    mesh.attributes = VERTEX_POSITION | VERTEX_NORMAL | VERTEX_TEXCOORDS;
+    mesh.vertices.resize(sphere.getInterleavedVertexCount());
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(data[i * 8], data[i * 8 + 1], data[i * 8 + 2]);
+        vertex.Normal = glm::vec3(data[i * 8 + 3], data[i * 8 + 4], data[i * 8 + 5]);
+        vertex.TexCoords = glm::vec2(data[i * 8 + 6], data[i * 8 + 7]);
+        mesh.vertices[i] = vertex;
+    }
+    mesh.indices.assign(sphere.getIndices(), sphere.getIndices() + sphere.getIndexCount());
+    // the lower subdivisions have too few triangles to be worth levels
+    if (subdivision >= 3)
+        BuildLods(mesh, settings);
+
+    meshes.assign(1, mesh);
+    SaveMeshFile(cachePath, key, meshes);
+    return mesh;
+}
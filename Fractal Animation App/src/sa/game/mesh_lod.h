@@ -0,0 +1,59 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+///////////////////////////////////////////////////////////////////////////////
+// mesh_lod.h
+// ==========
+// Level of detail chains, built when a mesh is written to its cache file and
+// picked per frame from how big the mesh's error would be on screen.
+//
+// BuildLods simplifies with quadric error metrics (Garland & Heckbert): every
+// vertex sums the planes of the triangles around it, and the edge whose
+// collapse moves the surface least off those planes goes first. Collapses
+// are half edge, a vertex moves onto a neighbour, so every level is just
+// another index list over the mesh's own vertices: the levels share one
+// vertex buffer and selecting one only changes the range that is drawn.
+// Vertices at the same position are simplified as one, seams and flat
+// shaded faces keep their own normals and texture coordinates, and open
+// borders carry extra planes so holes do not grow. Collapses that would
+// flip a triangle or pinch the surface are skipped.
+//
+// One simplification pass runs to the largest error of the settings and the
+// index list is copied each time it passes one of them, so the levels are
+// nested and the work is done once. A level's Error is the distance its
+// surface may be off in mesh units; SelectLevel turns that into pixels with
+// the camera's field of view and the distance and takes the coarsest level
+// that stays under a pixel.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.h"
+
+struct LodSettings
+{
+    // surface error each level may reach as a fraction of the bounding box diagonal, finest first
+    std::vector<float> errors = { 0.0025f, 0.01f, 0.04f };
+    // a level is only kept if it has at most this fraction of the triangles of the level before it
+    float minReduction = 0.7f;
+};
+
+// chains the settings into a cache key, a change rebuilds the cached levels
+uint64_t HashLodSettings(const LodSettings& settings, uint64_t seed);
+
+// fills mesh.lods with simplified versions of mesh.indices
+void BuildLods(MeshData& mesh, const LodSettings& settings = LodSettings());
+
+// all levels in one index list for the GPU, level 0 first, and where each of them starts
+std::vector<unsigned int> FlattenLods(const MeshData& mesh, std::vector<MeshLevel>& levels);
+
+// coarsest level whose error covers at most pixelError pixels, for a mesh drawn at scale with its
+// closest point distance away; zoom is Camera::Zoom (vertical field of view in degrees)
+int SelectLevel(const std::vector<MeshLevel>& levels, float distance, float scale, float zoom, float screenHeight, float pixelError = 1.0f);
+
+// icosphere as a mesh, with levels from subdivision 3 up, cached at cachePath like the fractal meshes
+MeshData LoadOrBuildIcosphere(const std::string& cachePath, float radius, int subdivision, bool smooth,
+                              const LodSettings& settings = LodSettings());
+
+#endif
@@ -0,0 +1,321 @@
+// CPU mip chain generation, see mip_builder.h
+
+#include "mip_builder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_BUILDER_SSE2
+#endif
+// AVX is picked at run time, the build does not enable it globally
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define MIP_BUILDER_AVX
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define MIP_TARGET(x) __attribute__((target(x)))
+#else
+#define MIP_TARGET(x)
+#endif
+
+namespace
+{
+    const int BAND_ROWS = 16;               // dst rows per thread pool task
+    const float KAISER_RADIUS = 3.0f;       // in dst pixels
+    const float KAISER_ALPHA = 4.0f;
+    const double PI = 3.14159265358979323846;
+
+    // taps of one output pixel along one axis, weights sum to one
+    struct Taps {
+        int first;
+        int count;
+        int offset;     // into Filter1D::weights
+    };
+
+    struct Filter1D {
+        std::vector<Taps> taps;
+        std::vector<float> weights;
+    };
+
+    // zeroth order modified Bessel function, for the Kaiser window
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    double kaiser(double x)
+    {
+        if (std::fabs(x) >= KAISER_RADIUS)
+            return 0.0;
+        double sinc = x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+        double r = x / KAISER_RADIUS;
+        return sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+    }
+
+    // edges clamp, taps falling outside the image are folded onto the border pixel
+    Filter1D makeFilter(int srcSize, int dstSize, Mip_Filter filter)
+    {
+        Filter1D result;
+        double scale = (double)srcSize / dstSize;
+        double support = filter == MIP_BOX ? 0.5 * scale : KAISER_RADIUS * scale;
+        for (int d = 0; d < dstSize; d++)
+        {
+            double center = (d + 0.5) * scale;
+            int begin = (int)std::floor(center - support);
+            int end = (int)std::ceil(center + support);
+            Taps taps;
+            taps.first = std::max(begin, 0);
+            taps.count = std::min(end, srcSize) - taps.first;
+            taps.offset = (int)result.weights.size();
+            result.weights.resize(result.weights.size() + taps.count, 0.0f);
+            double total = 0.0;
+            std::vector<double> weights(taps.count, 0.0);
+            for (int s = begin; s < end; s++)
+            {
+                double w;
+                if (filter == MIP_BOX)
+                    w = std::max(0.0, std::min(s + 1.0, center + support) - std::max((double)s, center - support));
+                else
+                    w = kaiser((s + 0.5 - center) / scale);
+                weights[std::min(std::max(s, 0), srcSize - 1) - taps.first] += w;
+                total += w;
+            }
+            for (int k = 0; k < taps.count; k++)
+                result.weights[taps.offset + k] = (float)(weights[k] / total);
+            result.taps.push_back(taps);
+        }
+        return result;
+    }
+
+    float srgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // 8 bit sRGB to linear, and linear quantized to 16 bits back to 8 bit sRGB
+    struct SrgbTables {
+        float toLinear[256];
+        unsigned char fromLinear[65536];
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; i++)
+                toLinear[i] = srgbToLinear(i / 255.0f);
+            for (int i = 0; i < 65536; i++)
+            {
+                float l = i / 65535.0f;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                fromLinear[i] = (unsigned char)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+            }
+        }
+    };
+
+    const SrgbTables& srgbTables()
+    {
+        static SrgbTables tables;
+        return tables;
+    }
+
+    // a level in float, 3 channel images padded to 4 lanes
+    struct FloatImage {
+        int width = 0;
+        int height = 0;
+        std::vector<float> data;
+    };
+
+    int lanesFor(int channels)
+    {
+        return channels == 3 ? 4 : channels;
+    }
+
+    // row y of the source as floats, from the 8 bit input for the first level
+    void loadRow(const unsigned char* pixels, const FloatImage* image, int width, int channels, bool srgb, int y, float* out)
+    {
+        int lanes = lanesFor(channels);
+        if (image)
+        {
+            std::copy(&image->data[(size_t)y * width * lanes], &image->data[(size_t)(y + 1) * width * lanes], out);
+            return;
+        }
+        const SrgbTables& tables = srgbTables();
+        const unsigned char* row = pixels + (size_t)y * width * channels;
+        int colors = channels == 4 || channels == 2 ? channels - 1 : channels;
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                unsigned char v = row[x * channels + c];
+                out[x * lanes + c] = srgb && c < colors ? tables.toLinear[v] : v / 255.0f;
+            }
+            for (int c = channels; c < lanes; c++)
+                out[x * lanes + c] = 0.0f;
+        }
+    }
+
+    void filterRow(const Filter1D& filter, const float* src, int lanes, float* dst)
+    {
+        for (size_t d = 0; d < filter.taps.size(); d++)
+        {
+            const Taps& taps = filter.taps[d];
+            const float* w = &filter.weights[taps.offset];
+            const float* s = src + (size_t)taps.first * lanes;
+#ifdef MIP_BUILDER_SSE2
+            if (lanes == 4)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for (int k = 0; k < taps.count; k++)
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s + k * 4)));
+                _mm_storeu_ps(dst + d * 4, acc);
+                continue;
+            }
+#endif
+            for (int c = 0; c < lanes; c++)
+            {
+                float acc = 0.0f;
+                for (int k = 0; k < taps.count; k++)
+                    acc += w[k] * s[k * lanes + c];
+                dst[d * lanes + c] = acc;
+            }
+        }
+    }
+
+#ifdef MIP_BUILDER_AVX
+    bool detectAvx()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx");
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        // the OS has to save the YMM state too (OSXSAVE and XCR0)
+        return ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1) && ((_xgetbv(0) & 6) == 6);
+#else
+        return false;
+#endif
+    }
+
+    bool hasAvx()
+    {
+        static const bool avx = detectAvx();
+        return avx;
+    }
+
+    // the 8 float part of accumulateRow, returns how many floats it did
+    MIP_TARGET("avx")
+    size_t accumulateRowAvx(float* out, const float* row, float weight, size_t count)
+    {
+        size_t i = 0;
+        __m256 w8 = _mm256_set1_ps(weight);
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(w8, _mm256_loadu_ps(row + i))));
+        return i;
+    }
+#endif
+
+    // out += weight * row over count floats
+    void accumulateRow(float* out, const float* row, float weight, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIP_BUILDER_AVX
+        if (hasAvx())
+            i = accumulateRowAvx(out, row, weight, count);
+#endif
+#ifdef MIP_BUILDER_SSE2
+        __m128 w4 = _mm_set1_ps(weight);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(w4, _mm_loadu_ps(row + i))));
+#endif
+        for (; i < count; i++)
+            out[i] += weight * row[i];
+    }
+
+    void quantizeRow(const float* row, int width, int channels, bool srgb, unsigned char* out)
+    {
+        const SrgbTables& tables = srgbTables();
+        int lanes = lanesFor(channels);
+        int colors = channels == 4 || channels == 2 ? channels - 1 : channels;
+        for (int x = 0; x < width; x++)
+            for (int c = 0; c < channels; c++)
+            {
+                // Kaiser lobes can overshoot, clamp before quantizing
+                float v = std::min(std::max(row[x * lanes + c], 0.0f), 1.0f);
+                out[x * channels + c] = srgb && c < colors ? tables.fromLinear[(int)(v * 65535.0f + 0.5f)]
+                                                           : (unsigned char)(v * 255.0f + 0.5f);
+            }
+    }
+
+    // filters src (the 8 bit input, or the previous float level) into the next level
+    void downsample(const unsigned char* pixels, const FloatImage* image, int width, int height, int channels, bool srgb,
+                    Mip_Filter filter, FloatImage& next, MipLevel& level)
+    {
+        const int lanes = lanesFor(channels);
+        next.width = level.width = std::max(1, width / 2);
+        next.height = level.height = std::max(1, height / 2);
+        next.data.assign((size_t)next.width * next.height * lanes, 0.0f);
+        level.pixels.resize((size_t)level.width * level.height * channels);
+        const Filter1D horizontal = makeFilter(width, next.width, filter);
+        const Filter1D vertical = makeFilter(height, next.height, filter);
+        const size_t rowFloats = (size_t)next.width * lanes;
+
+        int bands = (next.height + BAND_ROWS - 1) / BAND_ROWS;
+        ThreadPool::Shared().ParallelFor(bands, [&](int band)
+        {
+            int y0 = band * BAND_ROWS;
+            int y1 = std::min(next.height, y0 + BAND_ROWS);
+            // source rows this band reads, filtered horizontally once each
+            int first = vertical.taps[y0].first;
+            int last = first;
+            for (int y = y0; y < y1; y++)
+                last = std::max(last, vertical.taps[y].first + vertical.taps[y].count);
+            std::vector<float> source((size_t)width * lanes);
+            std::vector<float> rows((size_t)(last - first) * rowFloats);
+            for (int r = first; r < last; r++)
+            {
+                loadRow(pixels, image, width, channels, srgb, r, source.data());
+                filterRow(horizontal, source.data(), lanes, &rows[(size_t)(r - first) * rowFloats]);
+            }
+            for (int y = y0; y < y1; y++)
+            {
+                const Taps& taps = vertical.taps[y];
+                float* out = &next.data[(size_t)y * rowFloats];
+                for (int k = 0; k < taps.count; k++)
+                    accumulateRow(out, &rows[(size_t)(taps.first + k - first) * rowFloats], vertical.weights[taps.offset + k], rowFloats);
+                quantizeRow(out, next.width, channels, srgb, &level.pixels[(size_t)y * level.width * channels]);
+            }
+        });
+    }
+}
+
+std::vector<MipLevel> BuildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                                    bool srgb, Mip_Filter filter, int maxLevels)
+{
+    std::vector<MipLevel> levels;
+    if (!pixels || width < 1 || height < 1 || channels < 1 || channels > 4)
+        return levels;
+    FloatImage current, next;
+    bool first = true;
+    while ((width > 1 || height > 1) && (maxLevels <= 0 || (int)levels.size() < maxLevels))
+    {
+        MipLevel level;
+        downsample(pixels, first ? nullptr : &current, width, height, channels, srgb, filter, next, level);
+        std::swap(current, next);
+        first = false;
+        width = level.width;
+        height = level.height;
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
@@ -0,0 +1,39 @@
+#ifndef MIP_BUILDER_H
+#define MIP_BUILDER_H
+///////////////////////////////////////////////////////////////////////////////
+// mip_builder.h
+// =============
+// Builds texture mip chains on the CPU so they can be computed once (when
+// cooking, or on a loader thread) instead of by glGenerateMipmap at runtime.
+//
+// Every level is filtered from the previous one kept in float, color channels
+// of sRGB images in linear light, and quantized back to 8 bits only for the
+// output. Filters are separable: each dst row band (one thread pool task)
+// filters the source rows it needs horizontally, then combines them
+// vertically. The vertical pass runs over whole rows with AVX when the CPU
+// has it (checked at run time) and SSE otherwise, the horizontal pass one
+// pixel per SSE register for 3 and 4 channel images, which are padded to 4
+// float lanes.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+enum Mip_Filter {
+    MIP_BOX,        // plain average of the footprint, cheap and soft
+    MIP_KAISER      // Kaiser windowed sinc, keeps detail, can ring slightly
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// the levels below a 1 to 4 channel 8 bit image, halving (rounded down) to 1x1 or until maxLevels are built
+// (0 for no limit). With srgb the first three channels are treated as sRGB encoded color, alpha and single
+// channel masks such as glyphs pass srgb = false
+std::vector<MipLevel> BuildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                                    bool srgb, Mip_Filter filter = MIP_BOX, int maxLevels = 0);
+
+#endif
@@ -10,14 +10,21 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "geometry_pool.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
 #include "shader.h"
+#include "texture_registry.h"
+#include "texture_array.h"
+#include "thread_pool.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -29,72 +36,201 @@ public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    vector<NodeData> nodes;             // the scene hierarchy, meshes are listed in the order the nodes reference them
     string directory;
     bool gammaCorrection;
+    unordered_map<unsigned int, TextureRef> textureRefs;  // one registry reference per texture, released with the model
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. with deferUpload nothing touches GL, so the model
+    // can be imported on any thread and Upload (or the first Draw) runs the GL part on the context thread.
+    // with a pool the meshes go into its shared buffers instead of getting buffers of their own
+    Model(string const &path, bool gamma = false, bool deferUpload = false, GeometryPool *pool = nullptr) : gammaCorrection(gamma), pool(pool)
     {
         loadModel(path);
+        if(!deferUpload)
+            Upload();
     }
 
-    // draws the model, and thus all its meshes
+    // creates the GL buffers of every imported mesh and acquires the textures, only the first call does anything
+    void Upload()
+    {
+        for(size_t i = 0; i < pending.meshes.size(); i++)
+        {
+            MeshData &data = pending.meshes[i];
+            // every level of detail goes into the one index buffer
+            vector<MeshLevel> levels;
+            vector<unsigned int> indices = FlattenLods(data, levels);
+            // the mesh keeps only the GPU copy, the CPU arrays go with pending below
+            if(pool)
+                meshes.push_back(Mesh(acquireTextures(pending.materials[i]), data.attributes, pool->Add(data.vertices, indices, data.attributes), levels));
+            else
+                meshes.push_back(Mesh(data.vertices, indices, acquireTextures(pending.materials[i]), data.attributes, levels));
+        }
+        pending = ModelData();
+    }
+
+    // draws the model, and thus all its meshes. meshes in a pool share a vertex array per layout, it is only bound when it changes
     void Draw(Shader &shader)
     {
+        Upload();
+        unsigned int bound = 0;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            meshes[i].Bind(shader);
+            if(meshes[i].VAO != bound)
+                glBindVertexArray(bound = meshes[i].VAO);
+            meshes[i].DrawElements();
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // picks every mesh's level of detail for a model drawn at scale with its closest point distance away, zoom is
+    // Camera::Zoom. meshes are a part of the model, the model's distance is a safe bound for all of them
+    void SelectLevels(float distance, float scale, float zoom, float screenHeight, float pixelError = 1.0f)
+    {
+        for(Mesh &mesh : meshes)
+            mesh.Level = SelectLevel(mesh.Levels, distance, scale, zoom, screenHeight, pixelError);
+    }
+
+    // queues every mesh on the pool with its texture array slot, pool.Submit() then draws the model (and whatever
+    // else was queued) with one multi draw. for models made with a pool and packed with PackTextures
+    void Queue()
+    {
+        Upload();
+        if(!pool)
+            return;
+        for(const Mesh &mesh : meshes)
+            pool->Queue(mesh.LevelRange(), mesh.AtlasRect, mesh.AtlasLayer);
+    }
+
+    // packs the first diffuse texture of every mesh into the builder and points the meshes at their slots,
+    // call builder.Build() afterwards and draw with batched.vs/batched.fs and the array bound
+    void PackTextures(TextureArrayBuilder &builder)
+    {
+        Upload();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            for(const Texture &texture : meshes[i].textures)
+            {
+                if(texture.type != "texture_diffuse")
+                    continue;
+                int index = builder.AddFile(directory + '/' + texture.path);
+                if(index >= 0)
+                {
+                    meshes[i].AtlasLayer = builder.Slot(index).layer;
+                    meshes[i].AtlasRect = builder.Slot(index).rect;
+                }
+                break;
+            }
+        }
     }
     
 private:
+    ModelData pending;      // imported but not uploaded yet, the meshes still own their arrays
+    GeometryPool *pool;     // shared buffers the meshes go to, null for buffers per mesh
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // the processed result is cached next to the file, later loads read that and never start ASSIMP
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
-        }
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // the cache is only good for the exact same file imported with the same flags
+        MappedFile source(path);
+        if(!source.Data())
+        {
+            cout << "ERROR::MODEL:: could not open " << path << endl;
+            return;
+        }
+        LodSettings lods;
+        uint64_t key = HashLodSettings(lods, HashValue(importFlags, HashBytes(source.Data(), source.Size())));
+        string cachePath = path + ".mesh";
+        // filled here and only handed to pending once complete
+        ModelData model;
+        if(!LoadModelFile(cachePath, key, model))
+        {
+            // whatever a broken cache file left behind must not mix with the import
+            model = ModelData();
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+            // walk ASSIMP's nodes recursively, that only lists the meshes, converting them is independent work for the pool
+            vector<aiMesh*> sources;
+            processNode(scene->mRootNode, scene, -1, model, sources);
+            model.meshes.resize(sources.size());
+            // levels of detail are built here, once, and come out of the cache on later loads
+            ThreadPool::Shared().ParallelFor(static_cast<int>(sources.size()), [&](int i)
+            {
+                model.meshes[i] = processMesh(sources[i]);
+                BuildLods(model.meshes[i], lods);
+            });
+            SaveModelFile(cachePath, key, model);
+        }
+        nodes = model.nodes;
+        // decoding needs no GL, it starts now and Upload only binds the textures once they arrive
+        for(const vector<MaterialTexture> &material : model.materials)
+            for(const MaterialTexture &texture : material)
+                TextureRegistry::Shared().Prefetch(directory + '/' + texture.path);
+        pending = std::move(model);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, int parent, ModelData &model, vector<aiMesh*> &sources)
     {
+        int index = static_cast<int>(model.nodes.size());
+        NodeData data;
+        // assimp matrices are row major, glm takes columns
+        const aiMatrix4x4 &m = node->mTransformation;
+        data.transform = glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+        data.parent = parent;
+        model.nodes.push_back(data);
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            model.nodes[index].meshes.push_back(static_cast<unsigned int>(sources.size()));
+            sources.push_back(mesh);
+            model.materials.push_back(processMaterial(scene->mMaterials[mesh->mMaterialIndex]));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, index, model, sources);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // only reads the scene, runs on pool threads
+    MeshData processMesh(const aiMesh *mesh)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vertices.reserve(mesh->mNumVertices);
+        // the GPU buffer only gets what the mesh has, bones are never imported
+        data.attributes = VERTEX_POSITION;
+        if (mesh->HasNormals())
+            data.attributes |= VERTEX_NORMAL;
+        if (mesh->mTextureCoords[0])
+            data.attributes |= VERTEX_TEXCOORDS;
+        if (mesh->mTextureCoords[0] && mesh->HasTangentsAndBitangents())
+            data.attributes |= VERTEX_TANGENTS;
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex = {};     // zeroed, the cache file should not depend on stack garbage
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -142,60 +278,59 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);        
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
+        return data;
+    }
+
+    // the texture references of a material, in the order Mesh::Draw numbers its samplers
+    vector<MaterialTexture> processMaterial(aiMaterial *material)
+    {
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-
+        vector<MaterialTexture> textures;
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
+        return textures;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // appends the paths of all material textures of a given type
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<MaterialTexture> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back({ typeName, str.C_Str() });
+        }
+    }
+
+    // loads the textures of a material if they're not loaded yet, the required info is returned as Texture structs.
+    vector<Texture> acquireTextures(const vector<MaterialTexture> &material)
+    {
+        vector<Texture> textures;
+        for(const MaterialTexture &reference : material)
+        {
+            // the texture registry hashes the path, so a texture used before (by this or any other model) is found in O(1)
+            Texture texture;
+            texture.id = TextureFromFile(reference.path.c_str(), this->directory);
+            texture.type = reference.type;
+            texture.path = reference.path;
+            textures.push_back(texture);
+            if(textureRefs.count(texture.id))
+                TextureRegistry::Shared().Release(texture.id); // the model already holds a reference to it
+            else
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                textureRefs.emplace(texture.id, TextureRef::Adopt(texture.id));
+                textures_loaded.push_back(texture);  // store it as texture loaded for entire model
             }
         }
         return textures;
@@ -208,38 +343,8 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // returns at once with a placeholder, the image is decoded and uploaded in the background.
+    // the caller owns one registry reference to the texture
+    return TextureRegistry::Shared().Acquire(filename, gamma);
 }
 #endif
@@ -0,0 +1,15 @@
+#version 330 core
+
+out vec4 color;
+
+in vec2 texCoord;
+in vec3 normal;
+in vec4 petalColor;
+
+uniform sampler2D ourTexture;
+uniform vec3 spriteColor;
+
+void main()
+{
+	color = vec4(spriteColor, 1.0) * petalColor * texture(ourTexture, texCoord);
+}
\ No newline at end of file
@@ -27,7 +27,9 @@ THE SOFTWARE.
 #ifndef PETAL_H
 #define PETAL_H
 #include <glad/glad.h>
+#include <cstddef>
 #include <cstdlib>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -152,4 +154,140 @@ public:
 };
 
 
+// per-instance petal shape, evaluated by petal.vs so every petal can morph on its own
+struct PetalInstance
+{
+    glm::vec4 Shape = glm::vec4(0.2f, 0.2f, 2.0f, 0.75f);  // width, curl, length, lift: the constants of Petal's formula
+    glm::vec4 Morph = glm::vec4(0.0f);                      // width, curl and length amplitude, phase
+    glm::vec4 Color = glm::vec4(1.0f);                      // scaled by the instance's pulse, see SetAnimation
+    glm::mat4 Model = glm::mat4(1.0f);                      // swayed about z in petal.vs
+};
+
+// Shader evaluated petals: only a shared (u,v) grid is stored, petal.vs computes the surface
+// from each instance's shape parameters, so all petals are drawn in one call and animate
+// without regenerating or re-uploading geometry. The instances are uploaded once; the only
+// values that change per frame, a sway angle and a color pulse per petal, go to a small
+// buffer of their own.
+class PetalField
+{
+private:
+    const unsigned int X_SEGMENTS = 64;
+    const unsigned int Y_SEGMENTS = 64;
+    GLuint VAO = 0, gridVBO = 0, EBO = 0, instanceVBO = 0, animVBO = 0;
+    unsigned int indexCount = 0;
+    unsigned int instanceCount = 0;
+    unsigned int instanceCapacity = 0;
+
+public:
+    PetalField()
+    {
+        std::vector<glm::vec2> grid;
+        for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+            for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+                grid.push_back(glm::vec2((float)x / (float)X_SEGMENTS, (float)y / (float)Y_SEGMENTS));
+        std::vector<unsigned int> indices;
+        for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
+        {
+            for (unsigned int x = 0; x < X_SEGMENTS; ++x)
+            {
+                unsigned int i0 = y * (X_SEGMENTS + 1) + x;
+                unsigned int i1 = i0 + X_SEGMENTS + 1;
+                indices.push_back(i0);
+                indices.push_back(i1);
+                indices.push_back(i0 + 1);
+                indices.push_back(i0 + 1);
+                indices.push_back(i1);
+                indices.push_back(i1 + 1);
+            }
+        }
+        indexCount = static_cast<unsigned int>(indices.size());
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &gridVBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &animVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+        glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(glm::vec2), &grid[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+        // per-instance attributes: shape, morph, color and the 4 columns of the model matrix
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        GLsizei stride = sizeof(PetalInstance);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PetalInstance, Shape));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PetalInstance, Morph));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PetalInstance, Color));
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(4 + i);
+            glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(PetalInstance, Model) + i * sizeof(glm::vec4)));
+        }
+        // sway and pulse, their pointers are set once the instance count is known
+        glEnableVertexAttribArray(8);
+        glEnableVertexAttribArray(9);
+        for (unsigned int i = 1; i < 10; i++)
+            glVertexAttribDivisor(i, 1);
+        glBindVertexArray(0);
+    }
+    ~PetalField()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &gridVBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &animVBO);
+    }
+
+    // uploads the instance parameters, only needed when they change, not every frame. sway starts at 0 and pulse at 1
+    void SetInstances(const std::vector<PetalInstance>& instances)
+    {
+        instanceCount = static_cast<unsigned int>(instances.size());
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (instanceCount > instanceCapacity)
+        {
+            instanceCapacity = instanceCount;
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(PetalInstance), instances.data(), GL_STATIC_DRAW);
+
+            // all sways, then all pulses, so each channel is copied straight from its array
+            std::vector<float> rest(instanceCapacity * 2, 0.0f);
+            std::fill(rest.begin() + instanceCapacity, rest.end(), 1.0f);
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, animVBO);
+            glBufferData(GL_ARRAY_BUFFER, rest.size() * sizeof(float), rest.data(), GL_STREAM_DRAW);
+            glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+            glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(instanceCapacity * sizeof(float)));
+            glBindVertexArray(0);
+        }
+        else if (instanceCount > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCount * sizeof(PetalInstance), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // per frame values, one per instance: the angle each petal is turned by about z and the factor its color is scaled by
+    void SetAnimation(const float* sway, const float* pulse)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, animVBO);
+        // orphaning keeps the driver from waiting on last frame's draw
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * 2 * sizeof(float), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCount * sizeof(float), sway);
+        glBufferSubData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(float), instanceCount * sizeof(float), pulse);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draws every instance with petal.vs, which expects the time uniform to drive the morph
+    void Draw()
+    {
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0, instanceCount);
+        glBindVertexArray(0);
+    }
+};
+
 #endif
@@ -0,0 +1,49 @@
+#version 330 core
+layout (location = 0) in vec2 aUV;
+layout (location = 1) in vec4 aShape;   // width, curl, length, lift
+layout (location = 2) in vec4 aMorph;   // width, curl, length amplitude, phase
+layout (location = 3) in vec4 aColor;
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in float aSway;   // streamed every frame, see PetalField::SetAnimation
+layout (location = 9) in float aPulse;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float time;
+
+out vec2 texCoord;
+out vec3 normal;
+out vec4 petalColor;
+
+const float PI = 3.14159265359;
+
+void main()
+{
+	// same surface as Petal, with the constants taken from the instance
+	vec3 shape = aShape.xyz * (1.0 + aMorph.xyz * sin(time + aMorph.w));
+	float width = shape.x;
+	float curl = shape.y;
+	float len = shape.z;
+	float u = aUV.x;
+	float v = aUV.y;
+
+	vec3 pos = vec3(cos(u * 2.0 * PI) * sin(v * PI) * width,
+	                cos(v + 0.5) * len + aShape.w,
+	                sin(u + 0.05) * curl);
+	vec3 dPdu = vec3(-sin(u * 2.0 * PI) * 2.0 * PI * sin(v * PI) * width, 0.0, cos(u + 0.05) * curl);
+	vec3 dPdv = vec3(cos(u * 2.0 * PI) * PI * cos(v * PI) * width, -sin(v + 0.5) * len, 0.0);
+
+	// turned about z by the sway, like glm::rotate(aModel, aSway, z)
+	float c = cos(aSway);
+	float s = sin(aSway);
+	mat4 sway = mat4(c, s, 0.0, 0.0,
+	                 -s, c, 0.0, 0.0,
+	                 0.0, 0.0, 1.0, 0.0,
+	                 0.0, 0.0, 0.0, 1.0);
+	mat4 world = model * aModel * sway;
+	gl_Position = projection * view * world * vec4(pos, 1.0);
+	normal = mat3(world) * cross(dPdu, dPdv);
+	texCoord = aUV;
+	petalColor = vec4(aColor.rgb * aPulse, aColor.a);
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#ifndef REFINE_SCHEDULER_H
+#define REFINE_SCHEDULER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Work that can be spread over many frames: coarse result first, then refined a slice at a time.
+class ProgressiveTask
+{
+public:
+    // disabled tasks are skipped, e.g. while whatever shows their result is hidden
+    bool Enabled = true;
+
+    virtual ~ProgressiveTask() {}
+    // identifies everything the result depends on (camera, parameters), a new key restarts the task
+    virtual uint64_t Key() = 0;
+    // throws the current result away and starts again from the coarsest level
+    virtual void Restart() = 0;
+    // does one small slice of work, returns true once the result is fully refined
+    virtual bool Step() = 0;
+};
+
+// Runs progressive tasks inside a per-frame time budget so interaction stays at frame rate.
+// CPU time is measured directly, GPU time of each task's steps with GL_TIME_ELAPSED queries
+// that are read back a few frames later without stalling. Converged tasks whose key did not
+// change cost nothing, their result is kept as is.
+class RefineScheduler
+{
+public:
+    float CpuBudgetMs = 4.0f;
+    float GpuBudgetMs = 4.0f;
+
+    RefineScheduler() {}
+    ~RefineScheduler()
+    {
+        for (Entry& entry : entries)
+            glDeleteQueries(QUERY_COUNT, entry.queries);
+    }
+
+    void Add(ProgressiveTask* task)
+    {
+        Entry entry;
+        entry.task = task;
+        glGenQueries(QUERY_COUNT, entry.queries);
+        entries.push_back(entry);
+    }
+
+    // true when every task has converged for its current key
+    bool Idle() const
+    {
+        for (const Entry& entry : entries)
+            if (entry.task->Enabled && !entry.converged)
+                return false;
+        return true;
+    }
+
+    // call once per frame on the GL thread
+    void Run()
+    {
+        auto start = std::chrono::steady_clock::now();
+        double gpuSpent = 0.0;
+        size_t count = entries.size();
+        for (size_t n = 0; n < count; n++)
+        {
+            // rotate the starting task so a slow one cannot starve the others
+            Entry& entry = entries[(first + n) % count];
+            collectQueries(entry);
+            if (!entry.task->Enabled)
+                continue;
+
+            uint64_t key = entry.task->Key();
+            bool restarted = false;
+            if (key != entry.key || !entry.started)
+            {
+                entry.key = key;
+                entry.started = true;
+                entry.converged = false;
+                entry.task->Restart();
+                restarted = true;
+            }
+            if (entry.converged)
+                continue;
+
+            GLuint query = entry.queries[entry.nextQuery];
+            bool timing = !entry.pending[entry.nextQuery];
+            if (timing)
+                glBeginQuery(GL_TIME_ELAPSED, query);
+            int steps = 0;
+            for (;;)
+            {
+                double cpuSpent = elapsedMs(start);
+                // a freshly restarted task always gets its coarse step so something is on screen
+                bool fits = cpuSpent + entry.cpuStepMs <= CpuBudgetMs && gpuSpent + entry.gpuStepMs <= GpuBudgetMs;
+                if (!fits && !(restarted && steps == 0))
+                    break;
+                auto stepStart = std::chrono::steady_clock::now();
+                entry.converged = entry.task->Step();
+                steps++;
+                entry.cpuStepMs = average(entry.cpuStepMs, elapsedMs(stepStart));
+                gpuSpent += entry.gpuStepMs;
+                if (entry.converged)
+                    break;
+            }
+            if (timing)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                entry.pending[entry.nextQuery] = true;
+                entry.pendingSteps[entry.nextQuery] = steps;
+                entry.nextQuery = (entry.nextQuery + 1) % QUERY_COUNT;
+            }
+        }
+        if (count > 0)
+            first = (first + 1) % count;
+    }
+
+private:
+    static const int QUERY_COUNT = 4;
+
+    struct Entry {
+        ProgressiveTask* task = nullptr;
+        uint64_t key = 0;
+        bool started = false;
+        bool converged = false;
+        double cpuStepMs = 0.0;     // running averages per step
+        double gpuStepMs = 0.0;
+        GLuint queries[QUERY_COUNT] = {};
+        bool pending[QUERY_COUNT] = {};
+        int pendingSteps[QUERY_COUNT] = {};
+        int nextQuery = 0;
+    };
+    std::vector<Entry> entries;
+    size_t first = 0;
+
+    static double elapsedMs(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    static double average(double current, double sample)
+    {
+        return current == 0.0 ? sample : current * 0.8 + sample * 0.2;
+    }
+
+    // folds finished timer queries into the per-step GPU estimate, never waits on the GPU
+    void collectQueries(Entry& entry)
+    {
+        for (int i = 0; i < QUERY_COUNT; i++)
+        {
+            if (!entry.pending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(entry.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(entry.queries[i], GL_QUERY_RESULT, &nanoseconds);
+            entry.pending[i] = false;
+            if (entry.pendingSteps[i] > 0)
+                entry.gpuStepMs = average(entry.gpuStepMs, nanoseconds / 1.0e6 / entry.pendingSteps[i]);
+        }
+    }
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
@@ -135,8 +136,32 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    // texture unit of a sampler uniform, -1 if the program has none by that name. units are handed out in order of
+    // first request and written to the program right then, drawing only has to bind textures to them
+    // ------------------------------------------------------------------------
+    int samplerUnit(const std::string& name)
+    {
+        for (size_t unit = 0; unit < samplers.size(); unit++)
+            if (samplers[unit] == name)
+                return (int)unit;
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0)
+            return -1;
+        int unit = (int)samplers.size();
+        samplers.push_back(name);
+        // uniforms live in the program, set it without disturbing whatever program is in use
+        GLint current;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(ID);
+        glUniform1i(location, unit);
+        glUseProgram(current);
+        return unit;
+    }
 
 private:
+    std::vector<std::string> samplers;  // sampler uniforms by the texture unit samplerUnit gave them
+
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -16,46 +16,58 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <math.h>
+#include <chrono>
+#include <memory>
 #ifndef __APPLE__
 #include "irrKlang.h"
 #endif
-#include <ft2build.h>
-#include FT_FREETYPE_H
 
 #include "petal.h"
 #include "objects.h"
 #include "icosphere.h"
+#include "fractal_background.h"
+#include "fractal_mesher.h"
+#include "mesh_lod.h"
+#include "refine_scheduler.h"
+#include "thread_pool.h"
+#include "anim_curves.h"
+#include "texture_streamer.h"
+#include "texture_registry.h"
+#include "texture_cooker.h"
+#include "virtual_texture.h"
+#include "glyph_atlas.h"
+#include "text_batch.h"
+#include "text_layout.h"
+#include "stream_buffer.h"
+#include "gl_features.h"
+#include "geometry_pool.h"
 
 #include "filesystem.h"
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
 
-/* TEXT RENDERING */
-struct Character {
-    GLuint TextureID;
-    glm::ivec2 Size;
-    glm::ivec2 Bearing;
-    GLuint Advance;
-};
-
 /* FUNCTIONS */
-void RenderText(Shader& s, std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color);
+void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 unsigned int loadTexture(const char* path);
 unsigned int loadCubemap(vector<std::string> faces);
-void initText();
+void initText(GlyphAtlas& atlas);
+void runScene(GLFWwindow* window);
 
 unsigned int planeVAO;
-std::map<GLchar, Character> Characters;
-GLuint textVAO, textVBO;
 unsigned int VBO, VAO = 0;
 bool Keys[1024];
 bool firstMouse = true;
 bool onPerspective = true;
+bool fractalBackground = false;
+bool showMandelbulb = false;
+bool shaderPetals = false;
+bool virtualGround = false;
+bool showStats = false;
 float SCR_WIDTH = 1000;
 float SCR_HEIGHT = 900;
 float speed = .1f;
@@ -68,11 +80,32 @@ GLfloat rotateY = 0.0f;
 GLfloat xoffset = 0.0f;
 GLfloat yoffset = 0.0f;
 
+/* TEXT RENDERING */
+// the batch lives in runScene with the other GL objects, RenderText reaches it through this
+TextBatch* hudText = nullptr;
+float statsRefresh = 0.0f;
+
 /* CAMERA */
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
-int main()
+int main(int argc, char** argv)
 {
+    /* TEXTURE COOKING */
+    // --cook <image>... writes a DXT compressed mip chain next to each image and exits
+    if (argc > 1 && std::string(argv[1]) == "--cook")
+    {
+        int failed = 0;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string cooked = CookedPath(argv[i]);
+            if (CookTexture(argv[i], cooked))
+                std::cout << argv[i] << " -> " << cooked << std::endl;
+            else
+                failed++;
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
     /* GLFW INITIALIZE */
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -101,16 +134,37 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // entry points glad leaves out on a 3.3 context, from the driver's extensions
+    LoadGLFeatures((GLADloadproc)glfwGetProcAddress, glfwExtensionSupported);
     /* GLFW INITIALIZE */
 
-    initText();
+    // everything that owns GL objects is a local of runScene, so it is destroyed while the context still exists
+    runScene(window);
+
+    glfwTerminate();
+    return 0;
+}
+
+/* SCENE */
+void runScene(GLFWwindow* window)
+{
+    /* TEXT RENDERING */
+    // every glyph in one texture, all text of a frame is drawn with one call
+    GlyphAtlas fontAtlas;
+    // per frame geometry goes through one fenced ring instead of buffers of its own
+    StreamBuffer streamBuffer(1 << 20);
+    TextBatch textBatch(fontAtlas, &streamBuffer);
+    hudText = &textBatch;
+    // laid out once, only redone when a value changes
+    TextLayout statsLines[3] = { fontAtlas, fontAtlas, fontAtlas };
+    initText(fontAtlas);
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    Shader textShader("TextShader.vs", "TextShader.fs");
+    Shader textShader("TextShader.vs", "TextShaderSDF.fs");
 
     glm::mat4 Text_projection = glm::ortho(0.0f, SCR_WIDTH, 0.0f, SCR_HEIGHT);
     textShader.use();
@@ -250,18 +304,6 @@ int main()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 
-    /* TEXT RENDERING VAO-VBO*/
-    glGenVertexArrays(1, &textVAO);
-    glGenBuffers(1, &textVBO);
-    glBindVertexArray(textVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    /* TEXT RENDERING VAO-VBO*/
-
     /* PLANE */
     unsigned int planeVBO;
     glGenVertexArrays(1, &planeVAO);
@@ -305,6 +347,82 @@ int main()
     unsigned int cubemap3Texture = loadCubemap(faces);
     /* TEXTURES */
 
+    /* FRACTAL BACKGROUND */
+    // rendered at half resolution, it is blurred by the palette anyway
+    FractalBackground fractal((int)SCR_WIDTH / 2, (int)SCR_HEIGHT / 2);
+
+    /* VIRTUAL GROUND TEXTURE */
+    // a 32768 texel Mandelbrot spread over the whole plane, only the pages in view are generated and kept resident
+    Shader groundShader("virtual_texture.vs", "virtual_texture.fs");
+    FractalView groundView;
+    groundView.maxIterations = 512;
+    VirtualTexture groundTexture(256, 16, [groundView](double u0, double v0, double texel, int size, unsigned char* rgba)
+    {
+        FractalBackground::RenderImage(groundView, u0, v0, texel, size, rgba);
+    });
+    // the plane texture coordinates run to 25
+    const float groundUvScale = 1.0f / 25.0f;
+
+    /* PROGRESSIVE REFINEMENT */
+    // expensive fractal passes refine a slice per frame within this budget
+    RefineScheduler scheduler;
+    scheduler.CpuBudgetMs = 6.0f;
+    scheduler.GpuBudgetMs = 4.0f;
+    scheduler.Add(&fractal);
+
+    /* SCENE GEOMETRY */
+    // the generated meshes share one vertex array, declared before them so it outlives their ranges
+    GeometryPool scenePool;
+
+    /* MANDELBULB */
+    // extracted on the thread pool the first time it is shown (later launches read it back from the cache file),
+    // drawn from the first frame after that finished
+    struct BulbData
+    {
+        MeshData mesh;
+        vector<MeshLevel> levels;
+        vector<unsigned int> indices;
+    };
+    std::unique_ptr<Mesh> mandelbulb;
+    std::shared_ptr<BulbData> bulbData;
+    std::future<void> bulbLoad;
+
+    /* ICOSPHERE */
+    // built once with its levels of detail and cached, each frame draws the level its size on screen calls for
+    std::unique_ptr<Mesh> icosphere;
+
+    /* SHADER PETALS */
+    // one shared (u,v) grid, every instance morphs on its own in petal.vs
+    Shader petalShader("petal.vs", "petal.fs");
+    PetalField petalField;
+    std::vector<PetalInstance> petalInstances;
+    std::vector<float> petalPhases;
+    for (int i = 0; i < 22; i++)
+    {
+        // the same two rings of 20 radian steps the classic petals are drawn with
+        int k = i < 11 ? i + 1 : 21 - i;
+        PetalInstance instance;
+        instance.Model = glm::rotate(glm::mat4(1.0f), 20.0f * k, glm::vec3(0.0f, 0.0f, 1.f));
+        instance.Morph = glm::vec4(0.3f, 0.5f, 0.1f, 0.6f * i);
+        // magenta, pulsed by the color curve
+        instance.Color = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
+        petalInstances.push_back(instance);
+        petalPhases.push_back(0.6f * i);
+    }
+    // uploaded once, the frames only stream each petal's sway and pulse
+    petalField.SetInstances(petalInstances);
+
+    /* ANIMATION CURVES */
+    // petal color pulses between .3 and 1, baked once instead of sin() and clamping every frame
+    AnimCurve colorCurve = AnimCurve::Procedural([](float t) { return std::max(sinf(t) / 2.0f + 0.5f, 0.3f); }, 2.0f * glm::pi<float>());
+    AnimCurve swayCurve = AnimCurve::Keyframed({ { 0.0f, 0.0f }, { 1.0f, 0.12f }, { 3.0f, -0.12f } }, 4.0f);
+    AnimTimeline petalTimeline;
+    int petalColorChannel = petalTimeline.AddChannel(colorCurve);
+    int petalSwayChannel = petalTimeline.AddChannel(swayCurve);
+    petalTimeline.SetPhases(petalPhases);
+    petalShader.use();
+    petalShader.setInt("ourTexture", 0);
+
     /* SET SHADERS */
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
@@ -325,6 +443,16 @@ int main()
 
         processInput(window);
 
+        // finish uploading textures that were decoded in the background
+        TextureStreamer::Shared().Update();
+
+        if (virtualGround)
+            groundTexture.Update();
+
+        fractal.Enabled = fractalBackground;
+        fractal.Update(currentFrame);
+        scheduler.Run();
+
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -332,6 +460,20 @@ int main()
         projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
         view = camera.GetViewMatrix();
 
+        /* VIRTUAL TEXTURE FEEDBACK */
+        // which ground pages the visible pixels need, read back a few frames later
+        glm::mat4 groundModel = glm::scale(glm::mat4(1.0f), glm::vec3(.01f));
+        if (virtualGround)
+        {
+            Shader& feedback = groundTexture.BeginFeedback((int)SCR_WIDTH, (int)SCR_HEIGHT, groundUvScale);
+            feedback.setMat4("projection", projection);
+            feedback.setMat4("view", view);
+            feedback.setMat4("model", groundModel);
+            glBindVertexArray(planeVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            groundTexture.EndFeedback();
+        }
+
         /* set shader uniforms */
         lightingShader.use();
         lightingShader.setMat4("projection", projection);
@@ -349,60 +491,131 @@ int main()
         lightingShader.setMat4("model", model);
         model = glm::translate(model, glm::vec3(0.0, 0.0, -.5f));
         glBindVertexArray(planeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (virtualGround)
+        {
+            groundShader.use();
+            groundShader.setMat4("projection", projection);
+            groundShader.setMat4("view", view);
+            groundShader.setMat4("model", groundModel);
+            groundShader.setVec3("spriteColor", glm::vec3(1.0f));
+            groundTexture.Bind(groundShader, 0, groundUvScale);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            lightingShader.use();
+            glBindTexture(GL_TEXTURE_2D, cubeTexture);
+        }
+        else
+            glDrawArrays(GL_TRIANGLES, 0, 6);
 
         const float linecolor[] = { 1.0f, 0.0f, 1.0f, 1.0f };
 
         /* ICOSPHERE */
-        Icosphere icosphere(1.0f, 3, false);
+        if (!icosphere)
+        {
+            MeshData sphere = LoadOrBuildIcosphere("icosphere.mesh", 1.0f, 3, false);
+            vector<MeshLevel> levels;
+            vector<unsigned int> indices = FlattenLods(sphere, levels);
+            icosphere.reset(new Mesh(vector<Texture>(), sphere.attributes, scenePool.Add(sphere.vertices, indices, sphere.attributes), levels));
+        }
         lightingShader.setMat4("model", model);
         model = glm::mat4(1.0f);
         model = glm::rotate(model, (GLfloat)glfwGetTime() * glm::radians(-33.25f) * 2.0f, glm::vec3(0.0f, 0.0f, 1.f));
         lightingShader.setMat4("model", model);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        icosphere.draw();
+        // unit sphere at the origin, its closest point is a radius nearer than its centre
+        icosphere->Level = SelectLevel(icosphere->Levels, glm::max(glm::length(camera.Position) - 1.0f, 0.0f), 1.0f, camera.Zoom, SCR_HEIGHT);
+        // one indirect command when the driver has multi draw indirect, a base vertex draw otherwise
+        scenePool.Queue(icosphere->LevelRange());
+        scenePool.Submit();
 
-        double  timeValue = glfwGetTime();
-        float greenValue = static_cast<float>(sin(timeValue) / 2.0 + 0.5);
-        float blueValue = static_cast<float>(sin(timeValue) / 2.0 + 0.5);
-        float redValue = static_cast<float>(sin(timeValue) / 2.0 + 0.5);
-
-        // put a lower limit on the color
-        if (greenValue <= .3)
-            greenValue = .3;
-        if (blueValue <= .3)
-            blueValue = .3;
-        if (redValue <= .3)
-            redValue = .3;
+        // the color curve already has the lower limit baked in
+        float blueValue = colorCurve.Evaluate(currentFrame);
+        float redValue = blueValue;
 
         lightingShader.setInt("spriteColor", 3);
         int vertexColorLocation = glGetUniformLocation(lightingShader.ID, "color");
 
-        for (int i = 0; i < 11; i++)
+        if (shaderPetals)
         {
-            glm::vec4 color = glm::vec4(blueValue, 0.0f, redValue, 1.0f);
-            lightingShader.setVec3("spriteColor", color);
-            glUniform4f(vertexColorLocation, redValue, 0.0f, blueValue, 1.0f);
-            model = glm::rotate(model, 20.0f, glm::vec3(0.0f, 0.0f, 1.f));
-            lightingShader.setMat4("model", model);
-            Petal petal;
-            petal.Draw();
+            petalShader.use();
+            petalShader.setMat4("projection", projection);
+            petalShader.setMat4("view", view);
+            petalShader.setMat4("model", model);
+            petalShader.setFloat("time", currentFrame);
+            petalShader.setVec3("spriteColor", glm::vec3(1.0f));
+            // every petal runs the curves at its own phase
+            petalTimeline.Evaluate(currentFrame);
+            petalField.SetAnimation(petalTimeline.Values(petalSwayChannel), petalTimeline.Values(petalColorChannel));
+            petalField.Draw();
+        }
+        else
+        {
+            for (int i = 0; i < 11; i++)
+            {
+                glm::vec4 color = glm::vec4(blueValue, 0.0f, redValue, 1.0f);
+                lightingShader.setVec3("spriteColor", color);
+                glUniform4f(vertexColorLocation, redValue, 0.0f, blueValue, 1.0f);
+                model = glm::rotate(model, 20.0f, glm::vec3(0.0f, 0.0f, 1.f));
+                lightingShader.setMat4("model", model);
+                Petal petal;
+                petal.Draw();
+            }
+        }
+
+        if (showMandelbulb)
+        {
+            if (!mandelbulb && !bulbLoad.valid())
+            {
+                // the job owns its result, so it can outlive the scene
+                std::shared_ptr<BulbData> data = std::make_shared<BulbData>();
+                bulbData = data;
+                bulbLoad = ThreadPool::Shared().Submit([data]()
+                {
+                    data->mesh = LoadOrExtractFractalMesh("mandelbulb.mesh", FractalFieldParams());
+                    data->indices = FlattenLods(data->mesh, data->levels);
+                });
+            }
+            if (!mandelbulb && bulbLoad.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                // only the upload happens on the GL thread
+                bulbLoad.get();
+                mandelbulb.reset(new Mesh(vector<Texture>(), bulbData->mesh.attributes,
+                                          scenePool.Add(bulbData->mesh.vertices, bulbData->indices, bulbData->mesh.attributes), bulbData->levels));
+                bulbData.reset();
+            }
+        }
+        if (showMandelbulb && mandelbulb)
+        {
+            // the field's bounds reach 1.2 * sqrt(3) from the bulb's centre
+            glm::vec3 bulbCentre(0.0f, 3.0f, 0.0f);
+            float bulbDistance = glm::max(glm::length(camera.Position - bulbCentre) - 2.08f, 0.0f);
+            mandelbulb->Level = SelectLevel(mandelbulb->Levels, bulbDistance, 1.0f, camera.Zoom, SCR_HEIGHT);
+            lightingShader.use();
+            glm::mat4 bulbModel = glm::translate(glm::mat4(1.0f), bulbCentre);
+            bulbModel = glm::rotate(bulbModel, currentFrame * 0.2f, glm::vec3(0.0f, 1.0f, 0.0f));
+            lightingShader.setMat4("model", bulbModel);
+            mandelbulb->Draw(lightingShader);
         }
 
         /* RENDER SKYBOX */
         glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap3Texture);
-        glDrawArrays(GL_TRIANGLES, 0, 72);
-        glBindVertexArray(0);
+        if (fractalBackground)
+            fractal.Draw(currentFrame);
+        else
+        {
+            skyboxShader.use();
+            view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
+            skyboxShader.setMat4("view", view);
+            skyboxShader.setMat4("projection", projection);
+            glBindVertexArray(skyboxVAO);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap3Texture);
+            glDrawArrays(GL_TRIANGLES, 0, 72);
+            glBindVertexArray(0);
+        }
         glDepthFunc(GL_LESS);
         /* RENDER SKYBOX */
-        switch (onPerspective)
+        // the instanced petals already include the second ring
+        switch (onPerspective && !shaderPetals)
         {
             case 1:
 
@@ -415,7 +628,40 @@ int main()
                     petal.Draw();
                 }
         }
+
+        /* STATS OVERLAY */
+        if (showStats)
+        {
+            // the values are refreshed four times a second, in between the lines are just drawn
+            if (currentFrame >= statsRefresh)
+            {
+                char line[128];
+                float y = SCR_HEIGHT - 30.0f;
+                const glm::vec3 statsColor(1.0f, 1.0f, 0.6f);
+                snprintf(line, sizeof(line), "%.0f fps  %.2f ms", deltaTime > 0.0f ? 1.0f / deltaTime : 0.0f, deltaTime * 1000.0f);
+                statsLines[0].Set(line, 10.0f, y, 0.4f, statsColor);
+                snprintf(line, sizeof(line), "textures %.1f MB  geometry %.1f MB%s", TextureRegistry::Shared().ResidentBytes() / (1024.0 * 1024.0),
+                         (scenePool.VertexBytes() + scenePool.IndexBytes()) / (1024.0 * 1024.0), scenePool.MultiDraw() ? "  indirect" : "");
+                statsLines[1].Set(line, 10.0f, y - 24.0f, 0.4f, statsColor);
+                if (virtualGround)
+                    snprintf(line, sizeof(line), "ground pages %d resident, %d pending", groundTexture.ResidentPages(), groundTexture.PendingPages());
+                else
+                    line[0] = '\0';
+                statsLines[2].Set(line, 10.0f, y - 48.0f, 0.4f, statsColor);
+                statsRefresh = currentFrame + 0.25f;
+            }
+            glDisable(GL_DEPTH_TEST);
+            for (TextLayout& statsLine : statsLines)
+                statsLine.Draw(textShader);
+            glEnable(GL_DEPTH_TEST);
+        }
+        // all text of the frame in one draw, on top of the scene
+        glDisable(GL_DEPTH_TEST);
+        textBatch.Draw(textShader);
+        glEnable(GL_DEPTH_TEST);
+
         glfwSwapBuffers(window);
+        streamBuffer.EndFrame();
         glfwPollEvents();
     }
 
@@ -423,9 +669,9 @@ int main()
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &skyboxVBO);
 
-
-    glfwTerminate();
-    return 0;
+    // glyphs first used this run are in the baked atlas next launch
+    fontAtlas.SaveBaked();
+    hudText = nullptr;
 }
 
 
@@ -449,6 +695,42 @@ void processInput(GLFWwindow* window)
         camera.GetViewMatrix();
         camera.ProcessMouseMovement(lastX, lastY);
     }
+    // B toggles between the skybox and the fractal background
+    static bool backgroundKeyDown = false;
+    bool backgroundKey = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+    if (backgroundKey && !backgroundKeyDown)
+        fractalBackground = !fractalBackground;
+    backgroundKeyDown = backgroundKey;
+    // M shows the Mandelbulb mesh
+    static bool bulbKeyDown = false;
+    bool bulbKey = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (bulbKey && !bulbKeyDown)
+        showMandelbulb = !showMandelbulb;
+    bulbKeyDown = bulbKey;
+    // P switches to the shader evaluated petals
+    static bool petalKeyDown = false;
+    bool petalKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (petalKey && !petalKeyDown)
+        shaderPetals = !shaderPetals;
+    petalKeyDown = petalKey;
+    // G puts the virtual fractal texture on the ground
+    static bool groundKeyDown = false;
+    bool groundKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (groundKey && !groundKeyDown)
+        virtualGround = !virtualGround;
+    groundKeyDown = groundKey;
+    // H shows the stats overlay
+    static bool statsKeyDown = false;
+    bool statsKey = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (statsKey && !statsKeyDown)
+        showStats = !showStats;
+    statsKeyDown = statsKey;
+    // T prints what the texture registry keeps resident
+    static bool reportKeyDown = false;
+    bool reportKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (reportKey && !reportKeyDown)
+        TextureRegistry::Shared().Report(std::cout);
+    reportKeyDown = reportKey;
 }
 
 /* CALLBACKS */
@@ -484,107 +766,25 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 /* LOAD TEXTURE WITH STBI */
+// decoded on the thread pool, the placeholder is replaced once the streamer has uploaded it.
+// the registry shares textures loaded more than once, the reference taken here is kept for the whole run
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-    return textureID;
+    return TextureRegistry::Shared().Acquire(path);
 }
 
 /* LOAD CUBEMAP FOR SKYBOX */
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return TextureRegistry::Shared().AcquireCubemap(faces);
 }
 
 /* RENDER TEXT */
-void RenderText(Shader& s, std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
+// queues the text, everything queued during a frame is drawn at its end
+void RenderText(std::string text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
 {
-    s.use();
-    glUniform3f(glGetUniformLocation(s.ID, "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(textVAO);
-
-    // Iterate through characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        GLfloat xpos = x + ch.Bearing.x * scale;
-        GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        GLfloat w = ch.Size.x * scale;
-        GLfloat h = ch.Size.y * scale;
-        // Update VBO for each character
-        GLfloat vertices[6][4] = {
-                { xpos,     ypos + h,   0.0, 0.0 },
-                { xpos,     ypos,       0.0, 1.0 },
-                { xpos + w, ypos,       1.0, 1.0 },
-
-                { xpos,     ypos + h,   0.0, 0.0 },
-                { xpos + w, ypos,       1.0, 1.0 },
-                { xpos + w, ypos + h,   1.0, 0.0 }
-        };
-        // Render text onto a quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        x += (ch.Advance >> 6) * scale;
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if (hudText)
+        hudText->Add(text, x, y, scale, color);
 }
 
 /* RENDER CUBE */
@@ -659,55 +859,9 @@ void renderCube()
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
 }
-void initText()
+void initText(GlyphAtlas& atlas)
 {
     /* TEXT RENDERING */
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft))
-        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-
-    FT_Face face;
-    if (FT_New_Face(ft, "Antonio-Bold.ttf", 0, &face))
-        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
-
-    FT_Set_Pixel_Sizes(face, 0, 48);
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    for (GLubyte c = 0; c < 128; c++)
-    {
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-        {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-            continue;
-        }
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_RED,
-                face->glyph->bitmap.width,
-                face->glyph->bitmap.rows,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                face->glyph->bitmap.buffer);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        //  store character for use
-        Character character = {
-                texture,
-                glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-                glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-                static_cast<GLuint>(face->glyph->advance.x)
-        };
-        Characters.insert(std::pair<GLchar, Character>(c, character));
-    }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+    // distance fields stay sharp at any text scale
+    atlas.LoadSDF("Antonio-Bold.ttf", 48);
 }
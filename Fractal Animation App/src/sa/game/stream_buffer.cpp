@@ -0,0 +1,101 @@
+// Fenced ring buffer for per frame geometry, see stream_buffer.h
+
+#include "stream_buffer.h"
+
+#include "gl_features.h"
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync& fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    if (buffer)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (mapped || mappedRange)
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+}
+
+// the buffer is bound to the copy write target so vertex array and array buffer bindings are left alone
+void StreamBuffer::create()
+{
+    size_t total = frameBytes * FRAMES;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    // a 4.4 context or GL_ARB_buffer_storage on the 3.3 one, see gl_features.h
+    if (glFeatures.BufferStorage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+    }
+    if (!mapped)
+        glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::Allocate(size_t bytes, size_t alignment)
+{
+    if (!buffer)
+        create();
+    Allocation allocation;
+    // aligned in the whole buffer, callers turn offsets into first vertex indices
+    size_t base = frame * frameBytes;
+    size_t start = (base + head + alignment - 1) / alignment * alignment - base;
+    if (start + bytes > frameBytes)
+        return allocation;
+    head = start + bytes;
+    allocation.Offset = base + start;
+    if (mapped)
+    {
+        allocation.Pointer = mapped + allocation.Offset;
+        return allocation;
+    }
+
+    Flush();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    // the fence of this region was waited on, the GPU no longer reads it
+    allocation.Pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.Offset, bytes,
+                                          GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mappedRange = allocation.Pointer != nullptr;
+    return allocation;
+}
+
+void StreamBuffer::Flush()
+{
+    // coherent persistent mappings need nothing
+    if (!mappedRange)
+        return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mappedRange = false;
+}
+
+void StreamBuffer::EndFrame()
+{
+    if (!buffer)
+        return;
+    Flush();
+    if (fences[frame])
+        glDeleteSync(fences[frame]);
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % FRAMES;
+    head = 0;
+
+    GLsync& fence = fences[frame];
+    if (!fence)
+        return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        stalls++;
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+    glDeleteSync(fence);
+    fence = 0;
+}
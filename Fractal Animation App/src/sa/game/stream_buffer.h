@@ -0,0 +1,67 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+///////////////////////////////////////////////////////////////////////////////
+// stream_buffer.h
+// ===============
+// Ring buffer for geometry that is rebuilt every frame (text quads, debug
+// lines, instance data). One big buffer is split into FRAMES regions, a frame
+// sub-allocates linearly from its region and EndFrame fences it before moving
+// on to the next. The CPU only ever waits when it is FRAMES frames ahead of
+// the GPU, nothing is orphaned or copied by the driver.
+//
+// With buffer storage (GL 4.4, or ARB_buffer_storage on the 3.3 context, see
+// gl_features.h) the whole buffer is mapped once, persistent and coherent,
+// and Allocate just hands out pointers into it. Drivers without it get an
+// unsynchronized glMapBufferRange per allocation instead, the fences make
+// that just as safe. Either way a pointer is only good until the next call
+// on the stream and Flush must come before anything is drawn from it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+class StreamBuffer
+{
+public:
+    static const int FRAMES = 3;
+
+    struct Allocation
+    {
+        void* Pointer = nullptr;    // where to write, null if the frame's region is full
+        size_t Offset = 0;          // byte offset of the allocation in Buffer()
+    };
+
+    // frameBytes is what one frame may allocate, the GL objects are made on first use
+    StreamBuffer(size_t frameBytes) : frameBytes(frameBytes) {}
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // bytes from the current frame's region, Offset is a multiple of alignment
+    Allocation Allocate(size_t bytes, size_t alignment = 16);
+    // makes what was written visible to GL, call before drawing
+    void Flush();
+    // fences this frame's allocations and moves to the next region, waits if the GPU still reads it
+    void EndFrame();
+
+    unsigned int Buffer() const { return buffer; }
+    bool Persistent() const { return mapped != nullptr; }
+    size_t FrameBytes() const { return frameBytes; }
+    size_t UsedBytes() const { return head; }
+    int Stalls() const { return stalls; }
+
+private:
+    void create();
+
+    size_t frameBytes;
+    unsigned int buffer = 0;
+    unsigned char* mapped = nullptr;    // the whole buffer when persistently mapped
+    bool mappedRange = false;           // the fallback has a range mapped right now
+    GLsync fences[FRAMES] = {};
+    int frame = 0;                      // region allocations come from
+    size_t head = 0;                    // bytes used in that region
+    int stalls = 0;                     // times EndFrame had to wait for the GPU
+};
+
+#endif
@@ -0,0 +1,106 @@
+// Single draw call text rendering, see text_batch.h
+
+#include "text_batch.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+
+TextBatch::~TextBatch()
+{
+    if (VAO)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+    }
+}
+
+float AppendGlyphQuad(std::vector<TextVertex>& vertices, const Glyph& glyph, float x, float y, float scale, const glm::vec4& color)
+{
+    if (glyph.Size.x == 0 || glyph.Size.y == 0)
+        return glyph.Advance * scale;
+    float xpos = x + glyph.Bearing.x * scale;
+    float ypos = y - (glyph.Size.y - glyph.Bearing.y) * scale;
+    float w = glyph.Size.x * scale;
+    float h = glyph.Size.y * scale;
+
+    const glm::vec4& uv = glyph.UV;
+    TextVertex quad[6] = {
+        { glm::vec4(xpos,     ypos + h, uv.x, uv.y), color },
+        { glm::vec4(xpos,     ypos,     uv.x, uv.w), color },
+        { glm::vec4(xpos + w, ypos,     uv.z, uv.w), color },
+
+        { glm::vec4(xpos,     ypos + h, uv.x, uv.y), color },
+        { glm::vec4(xpos + w, ypos,     uv.z, uv.w), color },
+        { glm::vec4(xpos + w, ypos + h, uv.z, uv.y), color }
+    };
+    vertices.insert(vertices.end(), quad, quad + 6);
+    return glyph.Advance * scale;
+}
+
+void SetupTextVertexAttributes()
+{
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, Color));
+}
+
+void TextBatch::Add(const std::string& text, float x, float y, float scale, glm::vec3 color)
+{
+    glm::vec4 rgba(color, 1.0f);
+    vertices.reserve(vertices.size() + text.size() * 6);
+    for (size_t i = 0; i < text.size();)
+        x += AppendGlyphQuad(vertices, atlas.Get(DecodeUTF8(text, i)), x, y, scale, rgba);
+}
+
+void TextBatch::Draw(const Shader& shader)
+{
+    if (vertices.empty())
+        return;
+    if (!VAO)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+    }
+    glBindVertexArray(VAO);
+
+    size_t bytes = vertices.size() * sizeof(TextVertex);
+    StreamBuffer::Allocation allocation;
+    if (stream)
+        allocation = stream->Allocate(bytes, sizeof(TextVertex));
+    unsigned int source = VBO;
+    GLint first = 0;
+    if (allocation.Pointer)
+    {
+        memcpy(allocation.Pointer, vertices.data(), bytes);
+        stream->Flush();
+        source = stream->Buffer();
+        first = (GLint)(allocation.Offset / sizeof(TextVertex));
+        glBindBuffer(GL_ARRAY_BUFFER, source);
+    }
+    else
+    {
+        // no stream or its region is full: orphan the old storage so the driver does not wait for last frame's draw
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (vertices.size() > capacity)
+            capacity = vertices.size() * 3 / 2;
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+    }
+    if (attributeBuffer != source)
+    {
+        SetupTextVertexAttributes();
+        attributeBuffer = source;
+    }
+
+    shader.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas.Texture());
+    glDrawArrays(GL_TRIANGLES, first, (GLsizei)vertices.size());
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    vertices.clear();
+}
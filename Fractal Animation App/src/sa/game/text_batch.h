@@ -0,0 +1,53 @@
+#ifndef TEXT_BATCH_H
+#define TEXT_BATCH_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "glyph_atlas.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+// one corner of a glyph quad, what TextShader.vs reads
+struct TextVertex
+{
+    glm::vec4 Vertex;       // position in pixels, atlas texcoords
+    glm::vec4 Color;
+};
+
+// appends the two triangles of glyph with the pen on the baseline at (x, y), returns the pen advance
+float AppendGlyphQuad(std::vector<TextVertex>& vertices, const Glyph& glyph, float x, float y, float scale, const glm::vec4& color);
+// points attributes 0 and 1 of the bound vertex array at TextVertex data in the bound buffer
+void SetupTextVertexAttributes();
+
+// Collects the quads of any number of strings and draws them all with one call, every glyph
+// comes from the same atlas texture. Strings added during a frame are drawn and cleared by Draw.
+// With a stream the quads are written into its ring, else into an orphaned buffer of its own.
+class TextBatch
+{
+public:
+    TextBatch(GlyphAtlas& atlas, StreamBuffer* stream = nullptr) : atlas(atlas), stream(stream) {}
+    ~TextBatch();
+    TextBatch(const TextBatch&) = delete;
+    TextBatch& operator=(const TextBatch&) = delete;
+
+    // appends the quads of UTF-8 text with its baseline starting at (x, y) in pixels
+    void Add(const std::string& text, float x, float y, float scale, glm::vec3 color);
+
+    // uploads the quads in one go, draws them with the atlas bound to unit 0 and starts a new batch
+    void Draw(const Shader& shader);
+
+    size_t GlyphCount() const { return vertices.size() / 6; }
+
+private:
+    GlyphAtlas& atlas;
+    StreamBuffer* stream;
+    std::vector<TextVertex> vertices;
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int attributeBuffer = 0;   // buffer the vertex array's attributes point at
+    size_t capacity = 0;        // vertices the buffer can hold
+};
+
+#endif
@@ -0,0 +1,102 @@
+// Cached text quads with dirty tracking, see text_layout.h
+
+#include "text_layout.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+TextLayout::~TextLayout()
+{
+    if (VAO)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+    }
+}
+
+void TextLayout::Set(const std::string& text, float x, float y, float scale, glm::vec3 color)
+{
+    glm::vec4 rgba(color, 1.0f);
+    if (!laidOut || origin != glm::vec2(x, y) || this->scale != scale || this->color != rgba)
+    {
+        this->text = text;
+        origin = glm::vec2(x, y);
+        this->scale = scale;
+        this->color = rgba;
+        laidOut = true;
+        Layout(0);
+        return;
+    }
+    if (text == this->text)
+        return;
+    // everything up to the first difference keeps its quads
+    size_t same = std::mismatch(this->text.begin(), this->text.begin() + std::min(text.size(), this->text.size()), text.begin()).first - this->text.begin();
+    // back to the start of the UTF-8 sequence the difference is in
+    auto continues = [](const std::string& s, size_t i) { return i < s.size() && ((unsigned char)s[i] & 0xC0) == 0x80; };
+    while (same > 0 && (continues(text, same) || continues(this->text, same)))
+        same--;
+    this->text = text;
+    Layout(same);
+}
+
+void TextLayout::Layout(size_t from)
+{
+    if (from == 0)
+    {
+        firstVertex.assign(1, 0);
+        pen.assign(1, origin.x);
+        vertices.clear();
+    }
+    firstVertex.resize(from + 1);
+    pen.resize(from + 1);
+    vertices.resize(firstVertex[from]);
+
+    float x = pen[from];
+    for (size_t i = from; i < text.size();)
+    {
+        size_t start = i;
+        x += AppendGlyphQuad(vertices, atlas.Get(DecodeUTF8(text, i)), x, origin.y, scale, color);
+        // continuation bytes never start a relayout, they just keep the arrays per byte
+        firstVertex.insert(firstVertex.end(), i - start, vertices.size());
+        pen.insert(pen.end(), i - start, x);
+    }
+    dirtyFrom = dirty ? std::min(dirtyFrom, firstVertex[from]) : firstVertex[from];
+    dirty = true;
+}
+
+void TextLayout::Draw(const Shader& shader)
+{
+    if (!VAO)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        SetupTextVertexAttributes();
+    }
+    glBindVertexArray(VAO);
+    if (dirty)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (vertices.size() > capacity)
+        {
+            capacity = vertices.size() * 3 / 2;
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(TextVertex), NULL, GL_DYNAMIC_DRAW);
+            dirtyFrom = 0;
+        }
+        if (dirtyFrom < vertices.size())
+            glBufferSubData(GL_ARRAY_BUFFER, dirtyFrom * sizeof(TextVertex), (vertices.size() - dirtyFrom) * sizeof(TextVertex), vertices.data() + dirtyFrom);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        dirty = false;
+    }
+    if (!vertices.empty())
+    {
+        shader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlas.Texture());
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindVertexArray(0);
+}
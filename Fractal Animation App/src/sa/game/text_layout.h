@@ -0,0 +1,53 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "text_batch.h"
+
+// A string laid out once into quads that live in their own vertex buffer. Set only redoes the
+// work when something changed: a new position, scale or color lays out everything again, a new
+// string only from the first character that differs, so a counter ticking at the end of a label
+// touches a few quads. Draw uploads just the changed range, unchanged text costs one draw call.
+class TextLayout
+{
+public:
+    TextLayout(GlyphAtlas& atlas) : atlas(atlas) {}
+    ~TextLayout();
+    TextLayout(const TextLayout&) = delete;
+    TextLayout& operator=(const TextLayout&) = delete;
+
+    // UTF-8 text with its baseline starting at (x, y) in pixels
+    void Set(const std::string& text, float x, float y, float scale, glm::vec3 color);
+
+    // draws the cached quads with the atlas bound to unit 0
+    void Draw(const Shader& shader);
+
+    const std::string& Text() const { return text; }
+    size_t GlyphCount() const { return vertices.size() / 6; }
+
+private:
+    // lays out text from character from on, keeping the quads before it
+    void Layout(size_t from);
+
+    GlyphAtlas& atlas;
+    std::string text;
+    glm::vec2 origin = glm::vec2(0.0f);
+    float scale = 1.0f;
+    glm::vec4 color = glm::vec4(1.0f);
+    bool laidOut = false;
+
+    std::vector<TextVertex> vertices;
+    std::vector<size_t> firstVertex;    // per byte of text and one past the end, where its quad starts
+    std::vector<float> pen;             // per byte of text and one past the end, pen x before it
+    size_t dirtyFrom = 0;               // first vertex the buffer does not have yet
+    bool dirty = false;
+
+    unsigned int VAO = 0, VBO = 0;
+    size_t capacity = 0;                // vertices the buffer can hold
+};
+
+#endif
@@ -0,0 +1,210 @@
+// Texture array and atlas packing, see texture_array.h
+
+#include "texture_array.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "mapped_file.h"
+#include "mip_builder.h"
+#include "stb_image.h"
+
+TextureArrayBuilder::TextureArrayBuilder(int layerSize, int gutter) : layerSize(layerSize), gutter(gutter)
+{
+}
+
+TextureArrayBuilder::~TextureArrayBuilder()
+{
+    if (texture)
+        glDeleteTextures(1, &texture);
+}
+
+int TextureArrayBuilder::AddFile(const std::string& path)
+{
+    auto found = files.find(path);
+    if (found != files.end())
+        return found->second;
+    MappedFile file(path);
+    int width, height, channels;
+    unsigned char* pixels = file.IsOpen() ? stbi_load_from_memory(file.Data(), (int)file.Size(), &width, &height, &channels, 4) : nullptr;
+    if (!pixels)
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return -1;
+    }
+    int index = Add(pixels, width, height, 4);
+    stbi_image_free(pixels);
+    files[path] = index;
+    return index;
+}
+
+int TextureArrayBuilder::Add(const unsigned char* pixels, int width, int height, int channels)
+{
+    // everything is stored as RGBA, grey and grey-alpha are spread over the color channels
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        const unsigned char* p = pixels + i * channels;
+        unsigned char* q = &rgba[i * 4];
+        q[0] = p[0];
+        q[1] = channels >= 3 ? p[1] : p[0];
+        q[2] = channels >= 3 ? p[2] : p[0];
+        q[3] = channels == 4 ? p[3] : channels == 2 ? p[1] : 255;
+    }
+
+    TextureSlot slot;
+    Layer* layer = nullptr;
+    if (width == layerSize && height == layerSize)
+    {
+        layer = &newLayer();
+        layer->whole = true;
+        slot.layer = (int)layers.size() - 1;
+        blit(*layer, rgba.data(), width, height, 0, 0, 0);
+    }
+    else
+    {
+        // too big for an atlas entry, use the first mip level that fits
+        std::vector<MipLevel> chain;
+        const unsigned char* source = rgba.data();
+        int limit = layerSize - 2 * gutter;
+        if (width > limit || height > limit)
+        {
+            int halvings = 0;
+            while ((width >> halvings) > limit || (height >> halvings) > limit)
+                halvings++;
+            chain = BuildMipChain(rgba.data(), width, height, 4, true, MIP_BOX, halvings);
+            for (const MipLevel& level : chain)
+            {
+                source = level.pixels.data();
+                width = level.width;
+                height = level.height;
+                if (width <= limit && height <= limit)
+                    break;
+            }
+        }
+        int x, y;
+        place(width + 2 * gutter, height + 2 * gutter, slot.layer, x, y);
+        blit(layers[slot.layer], source, width, height, x + gutter, y + gutter, gutter);
+        slot.rect = glm::vec4((float)(x + gutter), (float)(y + gutter), (float)width, (float)height) / (float)layerSize;
+    }
+    slots.push_back(slot);
+    return (int)slots.size() - 1;
+}
+
+int TextureArrayBuilder::mipLevels() const
+{
+    // below this level the mips would average neighbouring atlas entries into each other
+    int levels = 1;
+    while ((1 << levels) <= gutter && (layerSize >> levels) > 0)
+        levels++;
+    return levels;
+}
+
+TextureArrayBuilder::Layer& TextureArrayBuilder::newLayer()
+{
+    layers.emplace_back();
+    layers.back().pixels.assign((size_t)layerSize * layerSize * 4, 0);
+    return layers.back();
+}
+
+// first fit over the shelves of every atlas layer, opening a new shelf or layer when nothing fits
+bool TextureArrayBuilder::place(int width, int height, int& layer, int& x, int& y)
+{
+    // sizes in whole texels of the last mip, so every shelf and column starts on one too
+    int align = 1 << (mipLevels() - 1);
+    width = (width + align - 1) / align * align;
+    height = (height + align - 1) / align * align;
+    for (size_t l = 0; l < layers.size(); l++)
+    {
+        Layer& candidate = layers[l];
+        if (candidate.whole)
+            continue;
+        for (Shelf& shelf : candidate.shelves)
+        {
+            // skip shelves much taller than the image, they would waste most of their height
+            if (shelf.height >= height && shelf.height <= height * 2 && shelf.x + width <= layerSize)
+            {
+                layer = (int)l;
+                x = shelf.x;
+                y = shelf.y;
+                shelf.x += width;
+                return true;
+            }
+        }
+        if (candidate.nextY + height <= layerSize)
+        {
+            Shelf shelf = { candidate.nextY, height, width };
+            candidate.shelves.push_back(shelf);
+            candidate.nextY += height;
+            layer = (int)l;
+            x = 0;
+            y = shelf.y;
+            return true;
+        }
+    }
+    Layer& fresh = newLayer();
+    Shelf shelf = { 0, height, width };
+    fresh.shelves.push_back(shelf);
+    fresh.nextY = height;
+    layer = (int)layers.size() - 1;
+    x = 0;
+    y = 0;
+    return true;
+}
+
+// copies the image to (x, y) and repeats its edge pixels border pixels outwards so filtering does not bleed
+void TextureArrayBuilder::blit(Layer& layer, const unsigned char* rgba, int width, int height, int x, int y, int border)
+{
+    for (int row = -border; row < height + border; row++)
+    {
+        int sy = std::min(std::max(row, 0), height - 1);
+        unsigned char* out = &layer.pixels[((size_t)(y + row) * layerSize + x - border) * 4];
+        for (int column = -border; column < width + border; column++, out += 4)
+        {
+            int sx = std::min(std::max(column, 0), width - 1);
+            const unsigned char* in = rgba + ((size_t)sy * width + sx) * 4;
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            out[3] = in[3];
+        }
+    }
+}
+
+unsigned int TextureArrayBuilder::Build()
+{
+    if (layers.empty())
+        return texture;
+    int levels = mipLevels();
+
+    if (!texture)
+        glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // level 0 of every layer, then each mip level for all layers at once
+    std::vector<std::vector<MipLevel>> chains(layers.size());
+    for (size_t l = 0; l < layers.size(); l++)
+        chains[l] = BuildMipChain(layers[l].pixels.data(), layerSize, layerSize, 4, true, MIP_BOX, levels - 1);
+    std::vector<unsigned char> level;
+    for (int mip = 0; mip < levels; mip++)
+    {
+        int size = std::max(1, layerSize >> mip);
+        level.resize((size_t)size * size * 4 * layers.size());
+        for (size_t l = 0; l < layers.size(); l++)
+        {
+            const std::vector<unsigned char>& pixels = mip == 0 ? layers[l].pixels : chains[l][mip - 1].pixels;
+            std::copy(pixels.begin(), pixels.end(), level.begin() + (size_t)size * size * 4 * l);
+        }
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, GL_RGBA8, size, size, (GLsizei)layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
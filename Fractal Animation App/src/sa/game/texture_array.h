@@ -0,0 +1,79 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+///////////////////////////////////////////////////////////////////////////////
+// texture_array.h
+// ===============
+// Packs many textures into the layers of one GL_TEXTURE_2D_ARRAY so meshes
+// with different materials can be drawn with the same texture bound.
+//
+// Every image is converted to RGBA8. A full layer sized image gets a layer of
+// its own, anything smaller is shelf packed, as it arrives, into shared atlas
+// layers with a gutter of repeated edge pixels around it, and bigger images
+// are scaled down to fit. Each added image gets a TextureSlot (layer and UV
+// rect) right away; batched.vs/batched.fs read it from attributes 7 and 8 and
+// wrap the mesh UVs inside the rect. The mip chain stops where the gutter
+// would no longer keep neighbours apart, and atlas entries start and end on
+// multiples of the last level's texel size so no mip texel straddles two.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// where a packed texture ended up, rect is (u offset, v offset, u size, v size) inside the layer
+struct TextureSlot
+{
+    int layer = -1;
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+class TextureArrayBuilder
+{
+public:
+    // layers are layerSize squared, gutter pixels are left around every atlas entry
+    TextureArrayBuilder(int layerSize = 1024, int gutter = 4);
+    ~TextureArrayBuilder();
+
+    // adds an 8 bit image with 1 to 4 channels and returns its index
+    int Add(const unsigned char* pixels, int width, int height, int channels);
+    // decodes and adds an image file, the same path is only added once. Returns -1 if it cannot be read
+    int AddFile(const std::string& path);
+
+    const TextureSlot& Slot(int index) const { return slots[index]; }
+    int LayerCount() const { return (int)layers.size(); }
+
+    // uploads every layer with its mips, can be called again after adding more. Returns the array texture
+    unsigned int Build();
+    unsigned int ID() const { return texture; }
+
+private:
+    struct Shelf {
+        int y;
+        int height;
+        int x;          // next free column
+    };
+    struct Layer {
+        std::vector<unsigned char> pixels;
+        std::vector<Shelf> shelves;
+        int nextY = 0;
+        bool whole = false;     // holds a single full layer image
+    };
+
+    int layerSize;
+    int gutter;
+    unsigned int texture = 0;
+    std::vector<Layer> layers;
+    std::vector<TextureSlot> slots;
+    std::unordered_map<std::string, int> files;
+
+    // levels Build uploads, a gutter pixel or more is left around the entries on the last one
+    int mipLevels() const;
+    Layer& newLayer();
+    bool place(int width, int height, int& layer, int& x, int& y);
+    void blit(Layer& layer, const unsigned char* rgba, int width, int height, int x, int y, int border);
+};
+
+#endif
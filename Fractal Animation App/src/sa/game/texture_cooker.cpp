@@ -0,0 +1,189 @@
+// DXT texture cooking and cooked file loading, see texture_cooker.h
+
+#include "texture_cooker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "image_DXT.h"
+#include "mapped_file.h"
+#include "mip_builder.h"
+#include "stb_image.h"
+#include "thread_pool.h"
+
+namespace
+{
+    const unsigned int DDS_MAGIC = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+    const unsigned int FOURCC_DXT1 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+    const unsigned int FOURCC_DXT5 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+
+    // GL_MAX_TEXTURE_SIZE is at most this in practice, and a DXT5 level of it (1 GB) still fits a 32 bit size_t
+    const unsigned int MAX_COOKED_SIZE = 1 << 15;
+
+    size_t levelSize(int width, int height, int blockBytes)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+}
+
+std::string CookedPath(const std::string& source)
+{
+    return std::filesystem::path(source).replace_extension(".dds").string();
+}
+
+bool CookedIsCurrent(const std::string& source)
+{
+    std::error_code error;
+    auto cooked = std::filesystem::last_write_time(CookedPath(source), error);
+    if (error)
+        return false;
+    auto original = std::filesystem::last_write_time(source, error);
+    // a cooked file without its source is still good
+    return error || cooked >= original;
+}
+
+std::vector<unsigned char> CompressDXT(const unsigned char* pixels, int width, int height, int channels)
+{
+    const bool alpha = (channels & 1) == 0;
+    const int blockBytes = alpha ? 16 : 8;
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    std::vector<unsigned char> compressed((size_t)blocksX * blocksY * blockBytes);
+
+    ThreadPool& pool = ThreadPool::Shared();
+    // a few bands per thread so uneven blocks even out
+    const int bands = std::min(blocksY, (int)(pool.Size() + 1) * 4);
+    pool.ParallelFor(bands, [&](int band)
+    {
+        int firstRow = blocksY * band / bands;
+        int lastRow = blocksY * (band + 1) / bands;
+        int y0 = firstRow * 4;
+        int bandHeight = std::min(height, lastRow * 4) - y0;
+        int size = 0;
+        const unsigned char* source = pixels + (size_t)y0 * width * channels;
+        unsigned char* blocks = alpha ? convert_image_to_DXT5(source, width, bandHeight, channels, &size)
+                                      : convert_image_to_DXT1(source, width, bandHeight, channels, &size);
+        if (blocks)
+        {
+            memcpy(&compressed[(size_t)firstRow * blocksX * blockBytes], blocks, size);
+            free(blocks);
+        }
+    });
+    return compressed;
+}
+
+bool CookTexture(const std::string& source, const std::string& destination, bool srgb, Mip_Filter filter)
+{
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(source.c_str(), &width, &height, &channels, 0);
+    if (!pixels)
+    {
+        std::cout << "Texture failed to load at path: " << source << std::endl;
+        return false;
+    }
+    const bool alpha = (channels & 1) == 0;
+
+    // full chain down to 1x1, filtered once here so the game never has to
+    std::vector<MipLevel> chain = BuildMipChain(pixels, width, height, channels, srgb && channels >= 3, filter);
+    std::vector<std::vector<unsigned char>> levels;
+    levels.push_back(CompressDXT(pixels, width, height, channels));
+    stbi_image_free(pixels);
+    for (const MipLevel& level : chain)
+        levels.push_back(CompressDXT(level.pixels.data(), level.width, level.height, channels));
+
+    DDS_header header;
+    memset(&header, 0, sizeof(header));
+    header.dwMagic = DDS_MAGIC;
+    header.dwSize = 124;
+    header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    header.dwWidth = width;
+    header.dwHeight = height;
+    header.dwPitchOrLinearSize = (unsigned int)levels[0].size();
+    header.dwMipMapCount = (unsigned int)levels.size();
+    header.sPixelFormat.dwSize = 32;
+    header.sPixelFormat.dwFlags = DDPF_FOURCC;
+    header.sPixelFormat.dwFourCC = alpha ? FOURCC_DXT5 : FOURCC_DXT1;
+    header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    std::ofstream file(destination, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::TEXTURE_COOKER:: could not write " << destination << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const std::vector<unsigned char>& blocks : levels)
+        file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    return static_cast<bool>(file);
+}
+
+bool ParseCookedTexture(const unsigned char* file, size_t size, CookedTexture& texture, size_t& payload)
+{
+    DDS_header header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, file, sizeof(header));
+    if (header.dwMagic != DDS_MAGIC)
+        return false;
+
+    int blockBytes;
+    if (header.sPixelFormat.dwFourCC == FOURCC_DXT1)
+    {
+        texture.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        blockBytes = 8;
+    }
+    else if (header.sPixelFormat.dwFourCC == FOURCC_DXT5)
+    {
+        texture.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        blockBytes = 16;
+    }
+    else
+        return false;
+
+    // nothing GL could hold, and small enough that no level size below overflows
+    if (header.dwWidth == 0 || header.dwHeight == 0 || header.dwWidth > MAX_COOKED_SIZE || header.dwHeight > MAX_COOKED_SIZE)
+        return false;
+    int width = (int)header.dwWidth, height = (int)header.dwHeight;
+    // a full chain ends at 1x1, more levels than that is a broken header
+    int maxLevels = 1;
+    while ((std::max(width, height) >> maxLevels) > 0)
+        maxLevels++;
+    int count = 1;
+    if (header.dwFlags & DDSD_MIPMAPCOUNT)
+    {
+        if (header.dwMipMapCount > (unsigned int)maxLevels)
+            return false;
+        count = std::max(1, (int)header.dwMipMapCount);
+    }
+
+    payload = sizeof(header);
+    size_t available = size - payload;
+    size_t total = 0;
+    texture.levels.clear();
+    for (int i = 0; i < count; i++)
+    {
+        CookedLevel level = { width, height, total, levelSize(width, height, blockBytes) };
+        // checked level by level, so total never exceeds the file size
+        if (level.size > available - total)
+            return false;
+        texture.levels.push_back(level);
+        total += level.size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return !texture.levels.empty();
+}
+
+bool LoadCookedTexture(const std::string& path, CookedTexture& texture)
+{
+    MappedFile file(path);
+    size_t payload;
+    if (!file.IsOpen() || !ParseCookedTexture(file.Data(), file.Size(), texture, payload))
+        return false;
+    const CookedLevel& last = texture.levels.back();
+    texture.data.assign(file.Data() + payload, file.Data() + payload + last.offset + last.size);
+    return true;
+}
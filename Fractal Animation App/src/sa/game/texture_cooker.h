@@ -0,0 +1,74 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+///////////////////////////////////////////////////////////////////////////////
+// texture_cooker.h
+// ================
+// Offline conversion of JPEG/PNG textures into DDS files holding a complete
+// DXT1 (opaque) or DXT5 (alpha) mip chain, and reading those files back.
+//
+// Blocks are encoded with the bundled image_DXT encoder. Every level is split
+// into bands of block rows that are compressed in parallel on the shared
+// thread pool; DXT blocks are stored row-major, so each band's output lands in
+// one contiguous range of the level. Run the game with
+//     --cook <image> [<image> ...]
+// to cook textures next to their sources, the streamer then uploads the
+// cooked file with glCompressedTexImage2D instead of decoding the image.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+#include "mip_builder.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// one mip level of a cooked texture, a byte range of CookedTexture::data
+struct CookedLevel
+{
+    int width;
+    int height;
+    size_t offset;
+    size_t size;
+};
+
+struct CookedTexture
+{
+    GLenum format = 0;      // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    std::vector<CookedLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+// where the cooked version of a source image lives: the same path with a .dds extension
+std::string CookedPath(const std::string& source);
+
+// true if the cooked file exists and is not older than its source
+bool CookedIsCurrent(const std::string& source);
+
+// compresses one level, DXT1 for 1 and 3 channels, DXT5 for 2 and 4
+std::vector<unsigned char> CompressDXT(const unsigned char* pixels, int width, int height, int channels);
+
+// decodes source, builds the mip chain, compresses every level and writes the DDS file.
+// srgb filters color in linear light, turn it off for normal and height maps
+bool CookTexture(const std::string& source, const std::string& destination, bool srgb = true, Mip_Filter filter = MIP_KAISER);
+
+// reads the format and level layout of a DXT1/DXT5 DDS file in memory (written by CookTexture or any tool
+// writing the same formats) without copying it, the level data starts payload bytes into file
+bool ParseCookedTexture(const unsigned char* file, size_t size, CookedTexture& texture, size_t& payload);
+
+// reads a DXT1/DXT5 DDS file into texture.data
+bool LoadCookedTexture(const std::string& path, CookedTexture& texture);
+
+#endif
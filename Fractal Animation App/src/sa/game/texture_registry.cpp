@@ -0,0 +1,188 @@
+// Reference counted texture cache with LRU eviction, see texture_registry.h
+
+#include "texture_registry.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iomanip>
+
+#include "hash.h"
+#include "texture_streamer.h"
+
+TextureRegistry& TextureRegistry::Shared()
+{
+    static TextureRegistry registry;
+    return registry;
+}
+
+TextureRegistry::TextureRegistry()
+{
+    TextureStreamer::Shared().OnResident = [this](unsigned int texture, size_t bytes) { resident(texture, bytes); };
+}
+
+namespace
+{
+    // the same file spelled one way: forward slashes, no empty or "." segments, ".." folded into its parent
+    std::string normalizePath(const std::string& path)
+    {
+        std::vector<std::string> segments;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+        size_t begin = 0;
+        while (begin <= path.size())
+        {
+            size_t end = path.find_first_of("/\\", begin);
+            if (end == std::string::npos)
+                end = path.size();
+            std::string segment = path.substr(begin, end - begin);
+            if (segment == ".." && !segments.empty() && segments.back() != "..")
+                segments.pop_back();
+            else if (!segment.empty() && segment != "." && !(segment == ".." && absolute))
+                segments.push_back(segment);
+            begin = end + 1;
+        }
+        std::string normalized = absolute ? "/" : "";
+        for (size_t i = 0; i < segments.size(); i++)
+            normalized += (i ? "/" : "") + segments[i];
+        return normalized.empty() ? "." : normalized;
+    }
+}
+
+unsigned int TextureRegistry::Acquire(const std::string& path, bool gamma)
+{
+    std::string normalized = normalizePath(path);
+    // the tag keeps the sRGB and linear uploads of one file apart
+    return acquire((gamma ? "srgb:" : "linear:") + normalized, normalized, false, std::vector<std::string>(1, normalized), gamma);
+}
+
+void TextureRegistry::Prefetch(const std::string& path, bool gamma)
+{
+    // Acquire hands the streamer the same normalized path
+    TextureStreamer::Shared().Prefetch(normalizePath(path), gamma);
+}
+
+unsigned int TextureRegistry::AcquireCubemap(const std::vector<std::string>& faces)
+{
+    // newlines keep ("ab", "c") and ("a", "bc") apart, the tag keeps a one face cubemap apart from a 2D texture
+    std::string source = "cube:";
+    std::string name;
+    std::vector<std::string> normalized;
+    for (const std::string& face : faces)
+    {
+        normalized.push_back(normalizePath(face));
+        source += normalized.back() + '\n';
+        name += (name.empty() ? "" : ", ") + normalized.back();
+    }
+    return acquire(source, name, true, normalized, false);
+}
+
+unsigned int TextureRegistry::acquire(const std::string& source, const std::string& name, bool cubemap, const std::vector<std::string>& paths, bool gamma)
+{
+    uint64_t key = HashBytes(source.data(), source.size());
+    auto range = lookup.equal_range(key);
+    for (auto found = range.first; found != range.second; ++found)
+    {
+        Entry& entry = entries[found->second];
+        if (entry.source != source)
+            continue;
+        if (entry.released)
+        {
+            lru.erase(entry.lru);
+            entry.released = false;
+        }
+        entry.references++;
+        // a prefetch of a texture that is already here has nobody to pick it up
+        if (!cubemap)
+            TextureStreamer::Shared().DropPrefetch(paths[0], gamma);
+        return entry.texture;
+    }
+
+    TextureStreamer& streamer = TextureStreamer::Shared();
+    Entry entry;
+    entry.texture = cubemap ? streamer.LoadCubemap(paths) : streamer.Load2D(paths[0], gamma);
+    entry.name = name;
+    entry.source = source;
+    entry.key = key;
+    entry.references = 1;
+    // the placeholder until the streamer reports the real size
+    entry.bytes = cubemap ? 6 * 4 : 4;
+    residentBytes += entry.bytes;
+    lookup.emplace(key, entry.texture);
+    entries.emplace(entry.texture, entry);
+    evict();
+    return entry.texture;
+}
+
+void TextureRegistry::Retain(unsigned int texture)
+{
+    auto found = entries.find(texture);
+    if (found == entries.end())
+        return;
+    Entry& entry = found->second;
+    if (entry.released)
+    {
+        lru.erase(entry.lru);
+        entry.released = false;
+    }
+    entry.references++;
+}
+
+void TextureRegistry::Release(unsigned int texture)
+{
+    auto found = entries.find(texture);
+    if (found == entries.end())
+        return;
+    Entry& entry = found->second;
+    if (entry.references <= 0 || --entry.references > 0)
+        return;
+    entry.released = true;
+    entry.lru = lru.insert(lru.end(), texture);
+    evict();
+}
+
+void TextureRegistry::resident(unsigned int texture, size_t bytes)
+{
+    auto found = entries.find(texture);
+    if (found == entries.end())
+        return;
+    Entry& entry = found->second;
+    residentBytes = residentBytes - entry.bytes + bytes;
+    entry.bytes = bytes;
+    // the real size can push the total over the budget, the streamer calls this after its upload loop
+    evict();
+}
+
+void TextureRegistry::evict()
+{
+    while (residentBytes > BudgetBytes && !lru.empty())
+    {
+        unsigned int texture = lru.front();
+        lru.pop_front();
+        Entry& entry = entries[texture];
+        TextureStreamer::Shared().Cancel(texture);
+        glDeleteTextures(1, &texture);
+        residentBytes -= entry.bytes;
+        auto range = lookup.equal_range(entry.key);
+        for (auto found = range.first; found != range.second; ++found)
+            if (found->second == texture)
+            {
+                lookup.erase(found);
+                break;
+            }
+        entries.erase(texture);
+    }
+}
+
+void TextureRegistry::Report(std::ostream& out) const
+{
+    std::vector<const Entry*> sorted;
+    for (const auto& entry : entries)
+        sorted.push_back(&entry.second);
+    std::sort(sorted.begin(), sorted.end(), [](const Entry* a, const Entry* b) { return a->bytes > b->bytes; });
+
+    out << "TEXTURES:: " << entries.size() << " resident, " << residentBytes / 1024 << " KB of "
+        << BudgetBytes / 1024 << " KB budget" << std::endl;
+    for (const Entry* entry : sorted)
+        out << std::setw(10) << entry->bytes / 1024 << " KB  refs " << std::setw(3) << entry->references
+            << "  " << entry->name << std::endl;
+}
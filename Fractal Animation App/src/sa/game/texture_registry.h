@@ -0,0 +1,112 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+///////////////////////////////////////////////////////////////////////////////
+// texture_registry.h
+// ==================
+// Process wide cache of loaded textures.
+//
+// Textures are keyed by their path(s) and load options. Paths are normalized
+// first (separators, "." and ".." segments), so "./a.png" and "a.png" are the
+// same texture; the lookup is by hash, and a hit is only taken when the
+// stored source matches, so a collision loads the other texture instead of
+// returning the wrong one.
+// Every Acquire adds a reference that Release (or a TextureRef going out of
+// scope) gives back. Textures nobody references stay resident for reuse and
+// are only deleted, least recently released first, once the resident bytes
+// exceed BudgetBytes. Sizes come from the texture streamer as textures become
+// resident.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextureRegistry
+{
+public:
+    // unreferenced textures are evicted while more than this is resident
+    size_t BudgetBytes = 512 * 1024 * 1024;
+
+    // process wide registry, the first call must come from the GL thread
+    static TextureRegistry& Shared();
+
+    TextureRegistry();
+
+    // returns the texture with one more reference, loading it through the texture streamer on first use
+    unsigned int Acquire(const std::string& path, bool gamma = false);
+    unsigned int AcquireCubemap(const std::vector<std::string>& faces);
+    // starts decoding a texture a later Acquire will ask for, from any thread: no GL and no registry state
+    void Prefetch(const std::string& path, bool gamma = false);
+    // adds a reference to a texture returned by Acquire
+    void Retain(unsigned int texture);
+    // gives a reference back, the texture may be evicted once none are left
+    void Release(unsigned int texture);
+
+    size_t ResidentBytes() const { return residentBytes; }
+    // one line per texture with its size, references and source, largest first
+    void Report(std::ostream& out) const;
+
+private:
+    struct Entry {
+        unsigned int texture = 0;
+        std::string name;
+        std::string source;                     // normalized paths and options, what a hash hit is checked against
+        uint64_t key = 0;
+        int references = 0;
+        size_t bytes = 0;
+        bool released = false;                  // unreferenced and in the LRU list
+        std::list<unsigned int>::iterator lru;
+    };
+    std::unordered_map<unsigned int, Entry> entries;        // by texture name
+    std::unordered_multimap<uint64_t, unsigned int> lookup; // hash of the source to the textures with it
+    std::list<unsigned int> lru;                            // unreferenced textures, least recently released first
+    size_t residentBytes = 0;
+
+    unsigned int acquire(const std::string& source, const std::string& name, bool cubemap, const std::vector<std::string>& paths, bool gamma);
+    void resident(unsigned int texture, size_t bytes);
+    void evict();
+};
+
+// Holds one reference to a registry texture for as long as it lives, copies add references.
+class TextureRef
+{
+public:
+    TextureRef() {}
+    // takes over the reference returned by TextureRegistry::Acquire
+    static TextureRef Adopt(unsigned int texture)
+    {
+        TextureRef ref;
+        ref.texture = texture;
+        return ref;
+    }
+    TextureRef(const TextureRef& other) : texture(other.texture)
+    {
+        if (texture)
+            TextureRegistry::Shared().Retain(texture);
+    }
+    TextureRef(TextureRef&& other) : texture(other.texture)
+    {
+        other.texture = 0;
+    }
+    TextureRef& operator=(TextureRef other)
+    {
+        std::swap(texture, other.texture);
+        return *this;
+    }
+    ~TextureRef()
+    {
+        if (texture)
+            TextureRegistry::Shared().Release(texture);
+    }
+
+    unsigned int ID() const { return texture; }
+
+private:
+    unsigned int texture = 0;
+};
+
+#endif
@@ -0,0 +1,366 @@
+// Asynchronous texture decode and budgeted upload, see texture_streamer.h
+
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "mapped_file.h"
+#include "mip_builder.h"
+#include "stb_image.h"
+#include "texture_cooker.h"
+#include "thread_pool.h"
+
+struct TextureStreamer::Image
+{
+    int components = 0;     // of decoded images, 0 for cooked ones
+    CookedTexture texels;   // every mip level, format 0 for raw 8 bit pixels
+    MappedFile file;        // a cooked file stays mapped until its bytes are in the unpack buffer
+    const unsigned char* bytes = nullptr;   // the level data, texels.data or straight from the mapping
+    size_t size = 0;
+    size_t offset = 0;      // where the image starts in the job's unpack buffer
+
+    bool Loaded() const { return bytes != nullptr; }
+};
+
+struct TextureStreamer::Job
+{
+    GLuint texture = 0;
+    GLenum target = GL_TEXTURE_2D;
+    bool gamma = false;
+    std::vector<std::string> paths;
+    std::vector<Image> images;      // written by the worker, read only once decoded is ready
+    std::future<void> decoded;
+
+    GLuint pbo = 0;
+    size_t total = 0;
+    size_t copied = 0;
+};
+
+namespace
+{
+    const unsigned char PLACEHOLDER[4] = { 128, 128, 128, 255 };
+
+    GLenum formatFor(int components)
+    {
+        if (components == 1)
+            return GL_RED;
+        if (components == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    GLenum internalFormatFor(int components, bool gamma)
+    {
+        if (gamma && components == 3)
+            return GL_SRGB;
+        if (gamma && components == 4)
+            return GL_SRGB_ALPHA;
+        return formatFor(components);
+    }
+}
+
+// decodes a source image and packs it with its mip chain (if wanted) the way a cooked file is laid out
+void TextureStreamer::decode(const std::string& path, bool mips, bool gamma, Image& image)
+{
+    image.texels = CookedTexture();
+    image.bytes = nullptr;
+    image.size = 0;
+    // decode from a mapping of the file rather than through stdio reads
+    image.file.Open(path);
+    if (!image.file.IsOpen())
+        return;
+    int width, height, components;
+    unsigned char* pixels = stbi_load_from_memory(image.file.Data(), (int)image.file.Size(), &width, &height, &components, 0);
+    image.file.Close();
+    if (!pixels)
+        return;
+    // sRGB color is filtered in linear light, data such as normal and height maps and masks as it is
+    std::vector<MipLevel> chain;
+    if (mips)
+        chain = BuildMipChain(pixels, width, height, components, gamma && components >= 3, MIP_BOX);
+    size_t size = (size_t)width * height * components;
+    size_t total = size;
+    for (const MipLevel& level : chain)
+        total += level.pixels.size();
+
+    image.components = components;
+    image.texels.data.resize(total);
+    memcpy(image.texels.data.data(), pixels, size);
+    stbi_image_free(pixels);
+    CookedLevel base = { width, height, 0, size };
+    image.texels.levels.push_back(base);
+    for (const MipLevel& level : chain)
+    {
+        CookedLevel mip = { level.width, level.height, size, level.pixels.size() };
+        memcpy(&image.texels.data[size], level.pixels.data(), level.pixels.size());
+        image.texels.levels.push_back(mip);
+        size += level.pixels.size();
+    }
+    image.bytes = image.texels.data.data();
+    image.size = image.texels.data.size();
+}
+
+// maps a cooked file, its compressed levels are later copied from the mapping straight into the unpack buffer
+bool TextureStreamer::mapCooked(const std::string& path, Image& image)
+{
+    size_t payload;
+    if (!image.file.Open(path) || !ParseCookedTexture(image.file.Data(), image.file.Size(), image.texels, payload))
+    {
+        image.file.Close();
+        return false;
+    }
+    const CookedLevel& last = image.texels.levels.back();
+    image.bytes = image.file.Data() + payload;
+    image.size = last.offset + last.size;
+    return true;
+}
+
+TextureStreamer& TextureStreamer::Shared()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+TextureStreamer::TextureStreamer()
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // workers may still be decoding into jobs they share ownership of, wait for them
+    for (std::shared_ptr<Job>& job : jobs)
+        if (job->decoded.valid())
+            job->decoded.wait();
+    for (auto& job : prefetched)
+        if (job.second->decoded.valid())
+            job.second->decoded.wait();
+}
+
+unsigned int TextureStreamer::Load2D(const std::string& path, bool gamma)
+{
+    std::shared_ptr<Job> job = submit(GL_TEXTURE_2D, std::vector<std::string>(1, path), gamma);
+    glBindTexture(GL_TEXTURE_2D, job->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return job->texture;
+}
+
+unsigned int TextureStreamer::LoadCubemap(const std::vector<std::string>& faces)
+{
+    std::shared_ptr<Job> job = submit(GL_TEXTURE_CUBE_MAP, faces, false);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, job->texture);
+    for (unsigned int i = 0; i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return job->texture;
+}
+
+// gamma changes how the mips are filtered, so it is part of what a prefetch is found by
+std::string TextureStreamer::prefetchKey(const std::string& path, bool gamma)
+{
+    return (gamma ? "srgb:" : "linear:") + path;
+}
+
+void TextureStreamer::Prefetch(const std::string& path, bool gamma)
+{
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    std::string key = prefetchKey(path, gamma);
+    if (!prefetched.count(key))
+        prefetched[key] = decodeJob(GL_TEXTURE_2D, std::vector<std::string>(1, path), gamma);
+}
+
+void TextureStreamer::DropPrefetch(const std::string& path, bool gamma)
+{
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    // the worker keeps its own reference to a job it is still decoding
+    prefetched.erase(prefetchKey(path, gamma));
+}
+
+std::shared_ptr<TextureStreamer::Job> TextureStreamer::submit(GLenum target, const std::vector<std::string>& paths, bool gamma)
+{
+    std::shared_ptr<Job> job;
+    if (target == GL_TEXTURE_2D)
+    {
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        auto found = prefetched.find(prefetchKey(paths[0], gamma));
+        if (found != prefetched.end())
+        {
+            job = found->second;
+            prefetched.erase(found);
+        }
+    }
+    if (!job)
+        job = decodeJob(target, paths, gamma);
+    glGenTextures(1, &job->texture);
+    jobs.push_back(job);
+    return job;
+}
+
+std::shared_ptr<TextureStreamer::Job> TextureStreamer::decodeJob(GLenum target, const std::vector<std::string>& paths, bool gamma)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->target = target;
+    job->gamma = gamma;
+    job->paths = paths;
+    job->images.resize(paths.size());
+    job->decoded = ThreadPool::Shared().Submit([job]()
+    {
+        // cooked files skip decoding entirely, a cubemap only uses them when every face has one
+        bool cooked = true;
+        for (const std::string& path : job->paths)
+            cooked = cooked && CookedIsCurrent(path);
+        // cubemaps are sampled without mips, 2D textures get their chain built here instead of by glGenerateMipmap
+        bool mips = job->target == GL_TEXTURE_2D;
+        for (size_t i = 0; i < job->paths.size(); i++)
+        {
+            Image& image = job->images[i];
+            if (!cooked || !mapCooked(CookedPath(job->paths[i]), image))
+                decode(job->paths[i], mips, job->gamma, image);
+        }
+        // a face that fell back to decoding would not match the compressed ones
+        bool mixed = false;
+        for (const Image& image : job->images)
+            mixed = mixed || (image.texels.format != job->images[0].texels.format);
+        if (mixed)
+            for (size_t i = 0; i < job->paths.size(); i++)
+                if (job->images[i].texels.format != 0)
+                    decode(job->paths[i], mips, job->gamma, job->images[i]);
+    });
+    return job;
+}
+
+void TextureStreamer::Cancel(unsigned int texture)
+{
+    for (size_t j = 0; j < jobs.size(); j++)
+        if (jobs[j]->texture == texture)
+        {
+            // a worker still decoding keeps its own reference to the job
+            if (jobs[j]->pbo)
+                glDeleteBuffers(1, &jobs[j]->pbo);
+            jobs.erase(jobs.begin() + j);
+            return;
+        }
+}
+
+void TextureStreamer::Update()
+{
+    size_t budget = UploadBudgetBytes;
+    std::vector<std::pair<unsigned int, size_t>> finished;
+    for (size_t j = 0; j < jobs.size() && budget > 0;)
+    {
+        Job& job = *jobs[j];
+        if (job.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            j++;
+            continue;
+        }
+
+        if (job.pbo == 0)
+        {
+            // the placeholder stays if any image (or cube face) failed
+            bool failed = false;
+            for (size_t i = 0; i < job.images.size(); i++)
+                if (!job.images[i].Loaded())
+                {
+                    std::cout << "Texture failed to load at path: " << job.paths[i] << std::endl;
+                    failed = true;
+                }
+            if (failed)
+            {
+                jobs.erase(jobs.begin() + j);
+                continue;
+            }
+            for (Image& image : job.images)
+            {
+                image.offset = job.total;
+                job.total += image.size;
+            }
+            glGenBuffers(1, &job.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, job.total, nullptr, GL_STREAM_DRAW);
+        }
+        else
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pbo);
+
+        // copy one slice, possibly spanning several images
+        size_t count = std::min(budget, job.total - job.copied);
+        unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, job.copied, count,
+                                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped)
+        {
+            size_t end = job.copied + count;
+            for (const Image& image : job.images)
+            {
+                size_t from = std::max(job.copied, image.offset);
+                size_t to = std::min(end, image.offset + image.size);
+                if (from < to)
+                    memcpy(mapped + (from - job.copied), image.bytes + (from - image.offset), to - from);
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            job.copied = end;
+        }
+        budget -= count;
+
+        if (job.copied == job.total)
+        {
+            finish(job);
+            finished.push_back(std::make_pair(job.texture, job.total));
+            jobs.erase(jobs.begin() + j);
+        }
+        else
+            j++;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // the callback may cancel jobs, the loop above is done with them
+    if (OnResident)
+        for (const auto& texture : finished)
+            OnResident(texture.first, texture.second);
+}
+
+// replaces the placeholder with the complete unpack buffer, the unpack buffer must be bound
+void TextureStreamer::finish(Job& job)
+{
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(job.target, job.texture);
+    int levels = 1;
+    for (size_t i = 0; i < job.images.size(); i++)
+    {
+        const Image& image = job.images[i];
+        GLenum face = job.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i : GL_TEXTURE_2D;
+        GLenum format = image.texels.format;
+        if (job.gamma && format != 0)
+            format = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        // the whole chain comes from the CPU, no glGenerateMipmap
+        levels = (int)image.texels.levels.size();
+        for (int level = 0; level < levels; level++)
+        {
+            const CookedLevel& mip = image.texels.levels[level];
+            void* offset = (void*)(image.offset + mip.offset);
+            if (format == 0)
+                glTexImage2D(face, level, internalFormatFor(image.components, job.gamma), mip.width, mip.height, 0,
+                             formatFor(image.components), GL_UNSIGNED_BYTE, offset);
+            else
+                glCompressedTexImage2D(face, level, format, mip.width, mip.height, 0, (GLsizei)mip.size, offset);
+        }
+    }
+    glTexParameteri(job.target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    // the driver keeps the buffer alive until the copy is done
+    glDeleteBuffers(1, &job.pbo);
+    job.pbo = 0;
+    job.images.clear();
+}
@@ -0,0 +1,85 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+///////////////////////////////////////////////////////////////////////////////
+// texture_streamer.h
+// ==================
+// Loads 2D textures and cubemaps without blocking the render thread.
+//
+// Load2D/LoadCubemap return a texture name right away. It holds a 1x1
+// placeholder until the real image is resident, so materials can keep the id
+// and never rebind. Files are memory mapped on the shared thread pool: the
+// cooked DDS next to the source when it is current (see texture_cooker.h) is
+// used as is, otherwise the source is decoded from the mapping by stb_image.
+// Update, called once per frame on the GL thread, copies the bytes into a
+// pixel-unpack buffer in slices of at most UploadBudgetBytes and, once a
+// texture's buffer is complete, respecifies the texture from it in one go.
+//
+// Prefetch starts the decode of a 2D texture from any thread before the GL
+// side asks for it, e.g. while a model is still being imported; Load2D of
+// the same path then picks the running (or finished) decode up.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class TextureStreamer
+{
+public:
+    // bytes copied into pixel-unpack buffers per Update, bounds the per frame cost
+    size_t UploadBudgetBytes = 8 * 1024 * 1024;
+
+    // process wide streamer, the first call must come from the GL thread
+    static TextureStreamer& Shared();
+
+    TextureStreamer();
+    // no GL calls here, the context may already be gone at exit
+    ~TextureStreamer();
+
+    // mipmapped, repeating 2D texture, gamma selects an sRGB internal format
+    unsigned int Load2D(const std::string& path, bool gamma = false);
+    // faces in +X, -X, +Y, -Y, +Z, -Z order
+    unsigned int LoadCubemap(const std::vector<std::string>& faces);
+
+    // starts decoding a 2D texture for a later Load2D of the same path and gamma, no GL calls, safe from any thread
+    void Prefetch(const std::string& path, bool gamma = false);
+    // forgets a prefetch that no Load2D will pick up, e.g. because the texture was already loaded
+    void DropPrefetch(const std::string& path, bool gamma = false);
+
+    // drops a pending load, call before deleting a texture that may still be loading
+    void Cancel(unsigned int texture);
+    // called from Update whenever a texture becomes resident, with the bytes uploaded for it. it runs after
+    // Update is done with its jobs, so it may Cancel others
+    std::function<void(unsigned int texture, size_t bytes)> OnResident;
+
+    // call once per frame on the GL thread
+    void Update();
+    // true when every requested texture is resident (or failed to load)
+    bool Idle() const { return jobs.empty(); }
+
+private:
+    struct Image;
+    struct Job;
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::unordered_map<std::string, std::shared_ptr<Job>> prefetched;  // decodes without a texture yet, by prefetchKey
+    std::mutex prefetchMutex;
+
+    // queues the decode on the thread pool, no GL
+    static std::shared_ptr<Job> decodeJob(GLenum target, const std::vector<std::string>& paths, bool gamma);
+    static std::string prefetchKey(const std::string& path, bool gamma);
+    std::shared_ptr<Job> submit(GLenum target, const std::vector<std::string>& paths, bool gamma);
+    void finish(Job& job);
+    // gamma filters the mips of 3 and 4 channel images as sRGB color
+    static void decode(const std::string& path, bool mips, bool gamma, Image& image);
+    static bool mapCooked(const std::string& path, Image& image);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads shared by everything that decodes, meshes or renders on the CPU.
+class ThreadPool
+{
+public:
+    // process wide pool sized to the machine, created on first use
+    static ThreadPool& Shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ThreadPool(unsigned int threads = 0)
+    {
+        // leave one core for the render thread
+        if (threads == 0)
+            threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    unsigned int Size() const { return (unsigned int)workers.size(); }
+
+    // queues a job, the future becomes ready once it ran
+    template <typename F>
+    std::future<void> Submit(F&& job)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(job));
+        std::future<void> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // runs body(i) for every i in [0, count) and returns when all of them finished.
+    // The calling thread works through the range too, so this is safe to call from inside a pool job.
+    void ParallelFor(int count, const std::function<void(int)>& body)
+    {
+        if (count <= 0)
+            return;
+        struct State {
+            std::function<void(int)> body;
+            std::atomic<int> next{ 0 };
+            std::atomic<int> done{ 0 };
+            int count = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<State>();
+        state->body = body;
+        state->count = count;
+        auto work = [state]()
+        {
+            for (int i = state->next++; i < state->count; i = state->next++)
+            {
+                state->body(i);
+                if (++state->done == state->count)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+        int helpers = std::min<int>(count - 1, (int)workers.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < helpers; i++)
+                jobs.emplace_back(work);
+        }
+        wake.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&]() { return state->done == state->count; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,375 @@
+// Sparse virtual texture with a feedback driven page cache, see virtual_texture.h
+
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+
+#include "thread_pool.h"
+
+VirtualTexture::VirtualTexture(int pagesWide, int cacheTiles, PageGenerator generator)
+    : pagesWide(std::min(std::max(pagesWide, 1), 256)), cacheTiles(std::min(std::max(cacheTiles, 2), 256)),
+      generator(std::move(generator)), results(std::make_shared<Results>()),
+      feedbackShader("virtual_texture.vs", "vt_feedback.fs")
+{
+    levels = 1;
+    while ((this->pagesWide >> levels) > 0)
+        levels++;
+
+    // page table, one texel per page, one mip level per virtual level
+    glGenTextures(1, &pageTable);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    table.resize(levels);
+    dirtyLevels.assign(levels, false);
+    for (int level = 0; level < levels; level++)
+    {
+        int n = pagesAt(level);
+        table[level].assign((size_t)n * n, Entry());
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, n, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, table[level].data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    // physical cache, no mips: the page table already picks the level
+    int cacheSize = this->cacheTiles * TILE_SIZE;
+    glGenTextures(1, &cache);
+    glBindTexture(GL_TEXTURE_2D, cache);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    tiles.resize((size_t)this->cacheTiles * this->cacheTiles);
+
+    // the coarsest page backs every other one, start on it right away
+    request(std::vector<uint32_t>(1, key(levels - 1, 0, 0)));
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    // pages still being generated only touch the shared results, nothing to wait for
+    glDeleteTextures(1, &pageTable);
+    glDeleteTextures(1, &cache);
+    glDeleteFramebuffers(1, &feedbackFBO);
+    glDeleteTextures(1, &feedbackColor);
+    glDeleteRenderbuffers(1, &feedbackDepth);
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence)
+            glDeleteSync(readback.fence);
+        glDeleteBuffers(1, &readback.buffer);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// feedback
+///////////////////////////////////////////////////////////////////////////////
+void VirtualTexture::resizeFeedback(int width, int height)
+{
+    if (feedbackFBO && width == feedbackWidth && height == feedbackHeight)
+        return;
+    feedbackWidth = width;
+    feedbackHeight = height;
+    if (!feedbackFBO)
+    {
+        glGenFramebuffers(1, &feedbackFBO);
+        glGenTextures(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+    }
+    glBindTexture(GL_TEXTURE_2D, feedbackColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::VIRTUAL_TEXTURE:: feedback framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+Shader& VirtualTexture::BeginFeedback(int screenWidth, int screenHeight, float uvScale)
+{
+    resizeFeedback(std::max(1, screenWidth / FEEDBACK_SCALE), std::max(1, screenHeight / FEEDBACK_SCALE));
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    savedBlend = glIsEnabled(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    // alpha 0 marks pixels that want no page, blending would mix page coordinates
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_BLEND);
+
+    feedbackShader.use();
+    feedbackShader.setFloat("vtPages", (float)pagesWide);
+    feedbackShader.setFloat("vtPageSize", (float)PAGE_SIZE);
+    feedbackShader.setInt("vtLevels", levels);
+    feedbackShader.setFloat("vtUvScale", uvScale);
+    // the feedback pixels are FEEDBACK_SCALE times bigger, pick the level a full size pixel would
+    feedbackShader.setFloat("vtLodBias", -std::log2((float)FEEDBACK_SCALE));
+    return feedbackShader;
+}
+
+void VirtualTexture::EndFeedback()
+{
+    Readback& readback = readbacks[nextReadback];
+    // the ring is full of unread results, the oldest one is dropped
+    if (readback.fence)
+    {
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+    }
+    if (!readback.buffer)
+        glGenBuffers(1, &readback.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (readback.width != feedbackWidth || readback.height != feedbackHeight)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, NULL, GL_STREAM_READ);
+        readback.width = feedbackWidth;
+        readback.height = feedbackHeight;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    nextReadback = (nextReadback + 1) % READBACKS;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    if (savedBlend)
+        glEnable(GL_BLEND);
+}
+
+// collects the pages of every finished read back, oldest first, without waiting on the GPU
+void VirtualTexture::readFeedback(std::vector<uint32_t>& wanted)
+{
+    std::unordered_set<uint32_t> seen;
+    for (int i = 0; i < READBACKS; i++)
+    {
+        Readback& readback = readbacks[(nextReadback + i) % READBACKS];
+        if (!readback.fence)
+            continue;
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        size_t size = (size_t)readback.width * readback.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            for (size_t p = 0; p < size; p += 4)
+            {
+                // r, g: page, b: level, a: 0 where nothing sampled the texture
+                if (pixels[p + 3] == 0 || pixels[p + 2] >= levels)
+                    continue;
+                int level = pixels[p + 2];
+                int x = pixels[p], y = pixels[p + 1];
+                if (x >= pagesAt(level) || y >= pagesAt(level))
+                    continue;
+                if (seen.insert(key(level, x, y)).second)
+                    wanted.push_back(key(level, x, y));
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// paging
+///////////////////////////////////////////////////////////////////////////////
+void VirtualTexture::Update()
+{
+    frame++;
+    std::vector<uint32_t> wanted;
+    readFeedback(wanted);
+    wanted.push_back(key(levels - 1, 0, 0));
+    request(wanted);
+    upload();
+    uploadTable();
+}
+
+void VirtualTexture::request(const std::vector<uint32_t>& wanted)
+{
+    // keep every resident page on the way to the root warm, collect the missing ones
+    std::vector<uint32_t> missing;
+    std::unordered_set<uint32_t> listed;
+    for (uint32_t page : wanted)
+    {
+        int x = page & 0xFF, y = (page >> 8) & 0xFF;
+        for (int level = page >> 16; level < levels; level++, x >>= 1, y >>= 1)
+        {
+            uint32_t k = key(level, x, y);
+            auto found = resident.find(k);
+            if (found != resident.end())
+                tiles[found->second].lastSeen = frame;
+            else if (!pending.count(k) && listed.insert(k).second)
+                missing.push_back(k);
+        }
+    }
+    // coarse pages first, they fill the most screen until the fine ones arrive
+    std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return (a >> 16) > (b >> 16); });
+
+    ThreadPool& pool = ThreadPool::Shared();
+    for (uint32_t k : missing)
+    {
+        if ((int)pending.size() >= MaxPendingPages)
+            break;
+        pending.insert(k);
+        int level = k >> 16, x = k & 0xFF, y = (k >> 8) & 0xFF;
+        double texel = 1.0 / ((double)pagesAt(level) * PAGE_SIZE);
+        double u0 = ((double)x * PAGE_SIZE - BORDER) * texel;
+        double v0 = ((double)y * PAGE_SIZE - BORDER) * texel;
+        std::shared_ptr<Results> shared = results;
+        PageGenerator generate = generator;
+        pool.Submit([shared, generate, k, u0, v0, texel]()
+        {
+            Finished page;
+            page.key = k;
+            page.texels.resize((size_t)TILE_SIZE * TILE_SIZE * 4);
+            generate(u0, v0, texel, TILE_SIZE, page.texels.data());
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->finished.push_back(std::move(page));
+        });
+    }
+}
+
+void VirtualTexture::upload()
+{
+    std::vector<Finished> batch;
+    {
+        std::lock_guard<std::mutex> lock(results->mutex);
+        size_t count = std::min(results->finished.size(), (size_t)std::max(MaxUploadsPerFrame, 0));
+        std::move(results->finished.begin(), results->finished.begin() + count, std::back_inserter(batch));
+        results->finished.erase(results->finished.begin(), results->finished.begin() + count);
+    }
+    if (batch.empty())
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, cache);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (Finished& page : batch)
+    {
+        pending.erase(page.key);
+        // every tile is in use this frame, the feedback asks for the page again later
+        int tile = freeTile();
+        if (tile < 0)
+            continue;
+        int tileX = tile % cacheTiles, tileY = tile / cacheTiles;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tileX * TILE_SIZE, tileY * TILE_SIZE, TILE_SIZE, TILE_SIZE,
+                        GL_RGBA, GL_UNSIGNED_BYTE, page.texels.data());
+
+        Page& slot = tiles[tile];
+        slot.level = page.key >> 16;
+        slot.x = page.key & 0xFF;
+        slot.y = (page.key >> 8) & 0xFF;
+        slot.lastSeen = frame;
+        resident[page.key] = tile;
+
+        Entry entry;
+        entry.tileX = (unsigned char)tileX;
+        entry.tileY = (unsigned char)tileY;
+        entry.level = (unsigned char)slot.level;
+        entry.valid = 255;
+        remap(slot.level, slot.x, slot.y, entry);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// an unused tile, or the least recently seen page not needed this frame. The root page is never evicted
+int VirtualTexture::freeTile()
+{
+    if (usedTiles < (int)tiles.size())
+        return usedTiles++;
+    int oldest = -1;
+    for (int i = 0; i < (int)tiles.size(); i++)
+    {
+        const Page& page = tiles[i];
+        if (page.level < 0)
+            return i;
+        if (page.level == levels - 1 || page.lastSeen >= frame)
+            continue;
+        if (oldest < 0 || page.lastSeen < tiles[oldest].lastSeen)
+            oldest = i;
+    }
+    if (oldest >= 0)
+        evict(oldest);
+    return oldest;
+}
+
+void VirtualTexture::evict(int tile)
+{
+    Page& page = tiles[tile];
+    resident.erase(key(page.level, page.x, page.y));
+    // the page and whatever fell back on it now fall back on the parent's mapping
+    Entry parent;
+    if (page.level + 1 < levels)
+        parent = table[page.level + 1][(size_t)(page.y >> 1) * pagesAt(page.level + 1) + (page.x >> 1)];
+    remap(page.level, page.x, page.y, parent);
+    page.level = -1;
+}
+
+// points a page and all its non-resident descendants at entry
+void VirtualTexture::remap(int level, int x, int y, Entry entry)
+{
+    table[level][(size_t)y * pagesAt(level) + x] = entry;
+    dirtyLevels[level] = true;
+    if (level == 0)
+        return;
+    for (int child = 0; child < 4; child++)
+    {
+        int cx = 2 * x + (child & 1), cy = 2 * y + (child >> 1);
+        if (!resident.count(key(level - 1, cx, cy)))
+            remap(level - 1, cx, cy, entry);
+    }
+}
+
+void VirtualTexture::uploadTable()
+{
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < levels; level++)
+    {
+        if (!dirtyLevels[level])
+            continue;
+        int n = pagesAt(level);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, n, n, GL_RGBA, GL_UNSIGNED_BYTE, table[level].data());
+        dirtyLevels[level] = false;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::Bind(const Shader& shader, int unit, float uvScale) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    glActiveTexture(GL_TEXTURE0 + unit + 1);
+    glBindTexture(GL_TEXTURE_2D, cache);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setInt("pageTable", unit);
+    shader.setInt("pageCache", unit + 1);
+    shader.setFloat("vtPages", (float)pagesWide);
+    shader.setFloat("vtPageSize", (float)PAGE_SIZE);
+    shader.setFloat("vtBorder", (float)BORDER);
+    shader.setFloat("vtCacheTiles", (float)cacheTiles);
+    shader.setInt("vtLevels", levels);
+    shader.setFloat("vtUvScale", uvScale);
+    shader.setFloat("vtLodBias", 0.0f);
+}
@@ -0,0 +1,38 @@
+#version 330 core
+out vec4 color;
+
+in vec2 virtualCoord;
+
+uniform sampler2D pageTable;
+uniform sampler2D pageCache;
+uniform float vtPages;
+uniform float vtPageSize;
+uniform float vtBorder;
+uniform float vtCacheTiles;
+uniform int vtLevels;
+uniform float vtLodBias;
+uniform vec3 spriteColor;
+
+void main()
+{
+	// same level choice as vt_feedback.fs
+	vec2 texels = virtualCoord * vtPages * vtPageSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+	int level = int(clamp(floor(lod), 0.0, float(vtLevels - 1)));
+
+	vec2 uv = clamp(virtualCoord, 0.0, 0.99999);
+	vec4 entry = texelFetch(pageTable, ivec2(uv * (vtPages / exp2(float(level)))), level) * 255.0;
+	if (entry.a < 0.5)
+	{
+		// nothing resident yet, not even the coarsest page
+		color = vec4(spriteColor * 0.5, 1.0);
+		return;
+	}
+	// the entry may map a coarser ancestor of the wanted page, find uv inside that one
+	vec2 inPage = fract(uv * (vtPages / exp2(floor(entry.b + 0.5)))) * vtPageSize;
+	float tileSize = vtPageSize + 2.0 * vtBorder;
+	vec2 cacheTexel = floor(entry.rg + 0.5) * tileSize + vtBorder + inPage;
+	color = vec4(spriteColor, 1.0) * textureLod(pageCache, cacheTexel / (vtCacheTiles * tileSize), 0.0);
+}
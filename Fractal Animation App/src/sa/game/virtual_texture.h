@@ -0,0 +1,136 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+///////////////////////////////////////////////////////////////////////////////
+// virtual_texture.h
+// =================
+// Sparse virtual texture: a huge mip mapped texture, split into square pages,
+// of which only the pages the camera actually sees are kept in VRAM.
+//
+// Resident pages live in one physical cache texture (a grid of tiles, each a
+// page plus a border). A page table texture with one texel per page and mip
+// level tells virtual_texture.fs where in the cache a page sits; pages that
+// are not resident point at their closest resident ancestor, so a coarser
+// version is shown until the page arrives. A low resolution feedback pass
+// renders which pages the visible pixels want, it is read back a few frames
+// later through pixel buffers and fences, never stalling. Missing pages are
+// produced by a PageGenerator (procedural, or decoded from disk) on the shared
+// thread pool and uploaded a few per frame, evicting the least recently seen
+// pages once the cache is full. Virtual resolution is independent of VRAM.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "shader.h"
+
+// fills size x size RGBA8 texels, texel (i, j) centered on virtual coordinate
+// (u0 + (i + 0.5) * texel, v0 + (j + 0.5) * texel). The texture covers (0, 0)-(1, 1),
+// border texels may fall slightly outside. Runs on pool threads.
+typedef std::function<void(double u0, double v0, double texel, int size, unsigned char* rgba)> PageGenerator;
+
+class VirtualTexture
+{
+public:
+    static const int PAGE_SIZE = 128;                   // texels per page side
+    static const int BORDER = 1;                        // texels repeated around a page for bilinear filtering
+    static const int TILE_SIZE = PAGE_SIZE + 2 * BORDER;
+    static const int FEEDBACK_SCALE = 8;                // feedback pass renders at 1/8 of the screen size
+
+    int MaxUploadsPerFrame = 6;
+    int MaxPendingPages = 32;                           // pages being generated at once
+
+    // pagesWide pages per side at full resolution (a power of two, at most 256),
+    // the cache holds cacheTiles x cacheTiles pages
+    VirtualTexture(int pagesWide, int cacheTiles, PageGenerator generator);
+    ~VirtualTexture();
+
+    // renders the feedback pass: binds the feedback target and returns its shader, the caller
+    // sets projection, view, model and draws everything that samples this texture with
+    // the same texture coordinates (scaled by uvScale) it uses in the color pass
+    Shader& BeginFeedback(int screenWidth, int screenHeight, float uvScale = 1.0f);
+    // queues the read back and restores the default framebuffer and viewport
+    void EndFeedback();
+
+    // call once per frame on the GL thread: reads finished feedback, requests missing pages,
+    // uploads finished ones and updates the page table
+    void Update();
+
+    // binds the page table and cache to units unit and unit + 1 and sets the lookup uniforms
+    void Bind(const Shader& shader, int unit = 0, float uvScale = 1.0f) const;
+
+    int Levels() const { return levels; }
+    int ResidentPages() const { return (int)resident.size(); }
+    int PendingPages() const { return (int)pending.size(); }
+
+private:
+    struct Page {
+        int level = -1;
+        int x = 0, y = 0;
+        uint64_t lastSeen = 0;
+    };
+    // page table texel: cache tile, the level of the page it maps and a valid flag
+    struct Entry {
+        unsigned char tileX = 0, tileY = 0, level = 0, valid = 0;
+    };
+    struct Finished {
+        uint32_t key;
+        std::vector<unsigned char> texels;
+    };
+    // shared with the pool jobs, which may still run after the texture was destroyed
+    struct Results {
+        std::mutex mutex;
+        std::vector<Finished> finished;
+    };
+    struct Readback {
+        GLuint buffer = 0;
+        GLsync fence = 0;
+        int width = 0, height = 0;
+    };
+
+    int pagesWide;
+    int levels;
+    int cacheTiles;
+    PageGenerator generator;
+    uint64_t frame = 0;
+
+    GLuint pageTable = 0;
+    GLuint cache = 0;
+    std::vector<std::vector<Entry>> table;              // per level, pagesAt(level) squared
+    std::vector<bool> dirtyLevels;
+
+    std::vector<Page> tiles;                            // what every cache tile holds
+    int usedTiles = 0;
+    std::unordered_map<uint32_t, int> resident;         // page key to cache tile
+    std::unordered_set<uint32_t> pending;
+    std::shared_ptr<Results> results;
+
+    Shader feedbackShader;
+    GLuint feedbackFBO = 0, feedbackColor = 0, feedbackDepth = 0;
+    int feedbackWidth = 0, feedbackHeight = 0;
+    GLint savedViewport[4] = {};
+    GLboolean savedBlend = GL_FALSE;
+    static const int READBACKS = 3;
+    Readback readbacks[READBACKS];
+    int nextReadback = 0;
+
+    int pagesAt(int level) const { return pagesWide >> level; }
+    static uint32_t key(int level, int x, int y) { return (uint32_t)level << 16 | (uint32_t)y << 8 | (uint32_t)x; }
+
+    void resizeFeedback(int width, int height);
+    void readFeedback(std::vector<uint32_t>& wanted);
+    void request(const std::vector<uint32_t>& wanted);
+    void upload();
+    int freeTile();
+    void evict(int tile);
+    void remap(int level, int x, int y, Entry entry);
+    void uploadTable();
+};
+
+#endif
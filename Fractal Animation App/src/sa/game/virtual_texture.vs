@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 2) in vec2 aTexCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float vtUvScale;
+
+out vec2 virtualCoord;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(position, 1.0);
+	virtualCoord = aTexCoord * vtUvScale;
+}
@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 feedback;
+
+in vec2 virtualCoord;
+
+uniform float vtPages;
+uniform float vtPageSize;
+uniform int vtLevels;
+uniform float vtLodBias;
+
+void main()
+{
+	// the level virtual_texture.fs will look up, from the screen space footprint in virtual texels
+	vec2 texels = virtualCoord * vtPages * vtPageSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+	int level = int(clamp(floor(lod), 0.0, float(vtLevels - 1)));
+	vec2 page = floor(clamp(virtualCoord, 0.0, 0.99999) * (vtPages / exp2(float(level))));
+	// page and level as bytes, alpha marks the pixel as used
+	feedback = vec4(page, float(level), 255.0) / 255.0;
+}